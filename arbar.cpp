@@ -0,0 +1,756 @@
+/**
+ * arbar - Multi-file archives coded with arb255 or biacode
+ *
+ * Every file is coded as one message (msgcodec.inc), so a run over many
+ * small files pays for process startup and model setup once instead of once
+ * per file. Files go through in batches: a batch is read with batched I/O
+ * (batchio.inc, io_uring when available), coded in parallel on a work
+ * stealing pool (workpool.inc), biggest first, while the next batch is
+ * read, and then written with batched I/O.
+ *
+ * Archive layout:
+ *
+ *   file | file | ... | directory | u64 directory size | "ARBARC01"
+ *
+ * directory = "ADIR", engine, file count, then for every file its name
+ * length, name, size, coded size and offset, all as varints after the tag.
+ * Coded files are stored in the order the files were given in. Only
+ * regular files are stored.
+ *
+ * With -e best the engine is arc_best and every file also gets a method
+ * varint after its offset (ARC_*): arb255, biacode, biacode after BWTS/MTF
+ * of the whole file or after the 4 byte delta shuffle of -t 4d, all coded
+ * as separate tasks on the pool, keeping the smallest; or stored, when none
+ * is smaller or biacode's model estimate (estimate.inc) already says the
+ * file won't shrink, so the coders aren't run on it at all.
+ *
+ * USAGE: arbar c [-e engine] [-j threads] [-I io] [-p model] [-T list] [-v] <archive> [file|dir]...
+ *        arbar x [-j threads] [-I io] [-p model] [-C dir] [-v] <archive>
+ *        arbar t <archive>
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include "batchio.inc"
+#include "estimate.inc"
+#include "seekable.inc"
+#include "workpool.inc"
+
+static const char arc_magic[9] = "ARBARC01";
+
+// Directory engine of archives coded with -e best
+static const int arc_best = ENG_COUNT;
+
+// How a file of an arc_best archive is coded
+enum { ARC_STORED, ARC_ARB255, ARC_BIACODE, ARC_BWTS, ARC_SHUF, ARC_METHODS };
+
+static const char *arc_method_name[ARC_METHODS] = {"stored", "arb255", "biacode", "bwts+biacode", "shuf4d+biacode"};
+static const int arc_method_eng[ARC_METHODS] = {-1, ENG_ARB255, ENG_BIACODE, ENG_BIACODE, ENG_BIACODE};
+static const shuffle_spec arc_shuf = {4, SHUF_DELTA};
+static const unsigned long long arc_bwts_max = 1 << 24; // Bigger files skip ARC_BWTS
+
+// Largest file size in a directory: a file is held in memory to be coded,
+// so a bigger size is corruption and must not get as far as an allocation
+static const unsigned long long arc_max_size = 1ULL << 40;
+
+struct arc_entry {
+  std::string name;
+  unsigned long long size;  // Uncompressed bytes
+  unsigned long long csize; // Coded bytes
+  unsigned long long off;   // Offset of the coded bytes in the archive
+  int method;               // ARC_*, for arc_best archives
+};
+
+static std::mutex print_lock;
+
+static const char *arc_eng_name(int eng) { return eng == arc_best ? "best" : eng_name[eng]; }
+
+static void arc_error(const char *what, const std::string &name) {
+  std::lock_guard<std::mutex> g(print_lock);
+  fprintf(stderr, "%s: %s\n", what, name.c_str());
+}
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nMulti-file archiver for arb255 and biacode\n");
+  fprintf(stderr, "USAGE: %s c [-e engine] [-j threads] [-I io] [-p model] [-T list] [-v] <archive> [file|dir]...\n",
+          progname);
+  fprintf(stderr, "       %s x [-j threads] [-I io] [-p model] [-C dir] [-v] <archive>\n", progname);
+  fprintf(stderr, "       %s t <archive>\n\n", progname);
+  fprintf(stderr, "  c:  create, directories are added recursively\n");
+  fprintf(stderr, "  x:  extract\n");
+  fprintf(stderr, "  t:  list\n");
+  fprintf(stderr, "  -e engine   arb255, biacode or best: per file the smallest of all engines and\n");
+  fprintf(stderr, "              transforms, or stored (default arb255)\n");
+  fprintf(stderr, "  -j threads  worker threads (default one per CPU)\n");
+  fprintf(stderr, "  -I io       file I/O: auto, io_uring or sync (default auto: io_uring if the kernel allows)\n");
+  fprintf(stderr, "  -p model    start every file from a snapshot made by mkprime\n");
+  fprintf(stderr, "  -T list     also add the files named in list, one per line\n");
+  fprintf(stderr, "  -C dir      extract under dir\n");
+  fprintf(stderr, "  -v          print the I/O backend and the number of system calls it made\n\n");
+}
+
+//===========================================================================
+// Directory table
+//===========================================================================
+
+void arc_pack(int eng, const std::vector<arc_entry> &ents, std::vector<BYTE> &v) {
+  static const char tag[] = "ADIR";
+  v.insert(v.end(), tag, tag + 4);
+  put_varint(v, eng);
+  put_varint(v, ents.size());
+  for (size_t i = 0; i < ents.size(); ++i) {
+    put_varint(v, ents[i].name.size());
+    v.insert(v.end(), ents[i].name.begin(), ents[i].name.end());
+    put_varint(v, ents[i].size);
+    put_varint(v, ents[i].csize);
+    put_varint(v, ents[i].off);
+    if (eng == arc_best)
+      put_varint(v, ents[i].method);
+  }
+}
+
+// Returns 0 if v is not a well formed directory for datalen bytes of files
+int arc_unpack(const std::vector<BYTE> &v, unsigned long long datalen, int *eng, std::vector<arc_entry> &ents) {
+  const BYTE *p = v.empty() ? NULL : &v[0], *end = p + v.size();
+  unsigned long long e, n, len;
+  arc_entry a;
+
+  if (v.size() < 4 || memcmp(p, "ADIR", 4) != 0)
+    return 0;
+  p += 4;
+  if (!get_varint(&p, end, &e) || !get_varint(&p, end, &n) || e > (unsigned long long)arc_best || n > v.size())
+    return 0;
+  *eng = (int)e;
+  ents.clear();
+  while (n--) {
+    if (!get_varint(&p, end, &len) || len > (unsigned long long)(end - p))
+      return 0;
+    a.name.assign((const char *)p, len);
+    p += len;
+    if (!get_varint(&p, end, &a.size) || !get_varint(&p, end, &a.csize) || !get_varint(&p, end, &a.off))
+      return 0;
+    if (a.off > datalen || a.csize > datalen - a.off || (a.size == 0) != (a.csize == 0) || a.size > arc_max_size)
+      return 0;
+    a.method = -1;
+    if (e == (unsigned long long)arc_best) {
+      if (!get_varint(&p, end, &len) || len >= ARC_METHODS || (len == ARC_STORED && a.csize != a.size))
+        return 0;
+      a.method = (int)len;
+    }
+    ents.push_back(a);
+  }
+  return p == end;
+}
+
+/**
+ * Read the directory from the trailer of the archive. Returns 0 on success.
+ */
+int arc_read_dir(int fd, int *eng, std::vector<arc_entry> &ents) {
+  std::vector<BYTE> dir;
+  BYTE tail[16];
+  unsigned long long len = 0;
+  off_t end = lseek(fd, 0, SEEK_END);
+
+  if (end < 16 || pread(fd, tail, 16, end - 16) != 16 || memcmp(tail + 8, arc_magic, 8) != 0) {
+    fprintf(stderr, "Not an archive\n");
+    return 2;
+  }
+  for (int i = 8; i--;)
+    len = (len << 8) | tail[i];
+  if (len > (unsigned long long)end - 16) {
+    fprintf(stderr, "Corrupt archive trailer\n");
+    return 2;
+  }
+  dir.resize(len);
+  if (len && pread(fd, &dir[0], len, end - 16 - (off_t)len) != (ssize_t)len) {
+    fprintf(stderr, "Could not read archive directory\n");
+    return 1;
+  }
+  if (!arc_unpack(dir, end - 16 - len, eng, ents)) {
+    fprintf(stderr, "Corrupt archive directory\n");
+    return 2;
+  }
+  return 0;
+}
+
+//===========================================================================
+// Helpers
+//===========================================================================
+
+// Add path, or every regular file below it, to ents
+void arc_add(const std::string &path, std::vector<arc_entry> &ents) {
+  struct stat st;
+  arc_entry a;
+
+  if (stat(path.c_str(), &st) != 0) {
+    arc_error("Could not stat", path);
+    return;
+  }
+  if (S_ISREG(st.st_mode)) {
+    if ((unsigned long long)st.st_size > arc_max_size) {
+      arc_error("Too big to archive", path);
+      return;
+    }
+    a.name = path;
+    a.size = st.st_size;
+    a.csize = a.off = 0;
+    a.method = ARC_STORED;
+    ents.push_back(a);
+  } else if (S_ISDIR(st.st_mode)) {
+    std::vector<std::string> names;
+    DIR *d = opendir(path.c_str());
+    struct dirent *de;
+
+    if (d == NULL) {
+      arc_error("Could not read directory", path);
+      return;
+    }
+    while ((de = readdir(d)) != NULL)
+      if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+        names.push_back(de->d_name);
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); ++i)
+      arc_add(path + (path[path.size() - 1] == '/' ? "" : "/") + names[i], ents);
+  }
+}
+
+// Names must stay below the extraction directory
+bool arc_safe_name(const std::string &s) {
+  if (s.empty() || s[0] == '/')
+    return false;
+  for (size_t i = 0, j; i <= s.size(); i = j + 1) {
+    j = s.find('/', i);
+    if (j == std::string::npos)
+      j = s.size();
+    if (s.compare(i, j - i, "..") == 0 && j - i == 2)
+      return false;
+  }
+  return true;
+}
+
+// mkdir -p for the directories leading to name
+void arc_make_dirs(const std::string &name) {
+  for (size_t i = name.find('/', 1); i != std::string::npos; i = name.find('/', i + 1))
+    mkdir(name.substr(0, i).c_str(), 0777);
+}
+
+// Read a whole file; returns false on error
+bool arc_read_file(const std::string &name, std::vector<BYTE> &v, unsigned long long *n) {
+  int fd = open(name.c_str(), O_RDONLY);
+  ssize_t r;
+
+  if (fd < 0)
+    return false;
+  for (*n = 0;; *n += r) {
+    if (*n == v.size())
+      v.resize(v.size() ? 2 * v.size() : 65536);
+    if ((r = read(fd, &v[*n], v.size() - *n)) <= 0)
+      break;
+  }
+  close(fd);
+  return r == 0;
+}
+
+/**
+ * Code n bytes at p by method m into c, growing it as needed; returns the
+ * coded size
+ */
+long arc_code_method(msg_codec &codec, int m, const BYTE *p, long n, std::vector<BYTE> &c) {
+  std::vector<BYTE> t;
+  long r;
+
+  if (m == ARC_STORED) {
+    c.assign(p, p + n);
+    return n;
+  }
+  if (m == ARC_BWTS || m == ARC_SHUF) {
+    t.assign(p, p + n);
+    if (m == ARC_BWTS)
+      bwts_mtf_encode(&t[0], n);
+    else
+      shuffle_encode(&t[0], n, &arc_shuf);
+    p = &t[0];
+  }
+  if (c.size() < (size_t)(n + n / 4 + 64))
+    c.resize(n + n / 4 + 64);
+  while ((r = codec.encode(arc_method_eng[m], p, n, &c[0], (long)c.size())) > (long)c.size())
+    c.resize(r);
+  return r;
+}
+
+// The inverse of arc_code_method, decoding under budget; returns false if src
+// is not n bytes coded by m
+bool arc_decode_method(msg_codec &codec, int m, const BYTE *src, long csize, BYTE *dst, long n,
+                       decode_budget *budget) {
+  if (m == ARC_STORED) {
+    memcpy(dst, src, n);
+    return csize == n;
+  }
+  if (codec.decode(arc_method_eng[m], src, csize, dst, n, budget) != n)
+    return false;
+  if (m == ARC_BWTS)
+    bwts_mtf_decode(dst, n);
+  else if (m == ARC_SHUF)
+    shuffle_decode(dst, n, &arc_shuf);
+  return true;
+}
+
+/**
+ * Whether n bytes at p look incompressible to biacode's model: then racing
+ * the coders on them is wasted
+ */
+bool arc_incompressible(const BYTE *p, long n) {
+  bia_estimate *e = new bia_estimate;
+  unsigned long long bytes;
+
+  e->reset(NULL);
+  e->add(p, n);
+  bytes = e->cost >> (est_frac + 3);
+  delete e;
+  return bytes >= (unsigned long long)(n - n / 64);
+}
+
+bool arc_write_all(int fd, const BYTE *p, unsigned long long n, off_t off) {
+  ssize_t r;
+
+  for (; n; n -= r, p += r, off += r)
+    if ((r = pwrite(fd, p, n, off)) <= 0)
+      return false;
+  return true;
+}
+
+//===========================================================================
+// Commands
+//===========================================================================
+
+// Files handled together: read with one batch_io call, coded on the pool,
+// written with one batch_io call. Buffers are kept for the next batch.
+struct arc_batch {
+  std::vector<long> idx; // Entries in the batch
+  std::vector<std::vector<BYTE> > raw, coded;
+  std::vector<std::vector<BYTE> > cand; // -e best: method m of file k at k * ARC_METHODS + m
+  std::vector<long> csize;
+  std::vector<io_req> io;
+  std::vector<char> bad;
+};
+
+/**
+ * Take the next files of todo, up to 256 of them or 16 MB
+ */
+void arc_next_batch(arc_batch &b, const std::vector<long> &todo, size_t *pos, const std::vector<arc_entry> &ents) {
+  unsigned long long bytes = 0;
+
+  b.idx.clear();
+  while (*pos < todo.size() && b.idx.size() < 256 && bytes < (16 << 20)) {
+    bytes += ents[todo[*pos]].size;
+    b.idx.push_back(todo[(*pos)++]);
+  }
+  if (b.raw.size() < b.idx.size()) {
+    b.raw.resize(b.idx.size());
+    b.coded.resize(b.idx.size());
+  }
+  b.io.resize(b.idx.size());
+  b.bad.assign(b.idx.size(), 0);
+}
+
+/**
+ * Run batches through load, code and store; batch k is coded on its own
+ * thread while batch k + 1 is loaded
+ */
+template <class L, class C, class S> void arc_batches(L load, C code, S store) {
+  arc_batch b[2];
+  int cur = 0;
+
+  load(b[0]);
+  while (!b[cur].idx.empty()) {
+    std::thread th([&] { code(b[cur]); });
+    load(b[cur ^ 1]);
+    th.join();
+    store(b[cur]);
+    cur ^= 1;
+  }
+}
+
+// Batch positions, biggest file first
+std::vector<long> arc_order(const arc_batch &b, const std::vector<arc_entry> &ents) {
+  std::vector<long> order;
+
+  for (size_t k = 0; k < b.idx.size(); ++k)
+    if (!b.bad[k])
+      order.push_back((long)k);
+  std::stable_sort(order.begin(), order.end(), [&](long x, long y) { return ents[b.idx[x]].size > ents[b.idx[y]].size; });
+  return order;
+}
+
+/**
+ * -e best: code every file of the batch with each method as its own task,
+ * the slow ones first, and keep the smallest. Files that look incompressible
+ * and empty ones are stored without racing.
+ */
+void arc_race(msg_codec &codec, work_pool &pool, arc_batch &b, std::vector<arc_entry> &ents) {
+  std::vector<long> order = arc_order(b, ents), tasks;
+  std::vector<char> store(b.idx.size(), 1);
+
+  pool.run(order, [&](long k, int) {
+    long n = (long)ents[b.idx[k]].size;
+    store[k] = n == 0 || arc_incompressible(&b.raw[k][0], n);
+  });
+
+  b.cand.resize(b.idx.size() * ARC_METHODS);
+  b.csize.assign(b.idx.size() * ARC_METHODS, -1);
+  for (int m = ARC_ARB255; m < ARC_METHODS; ++m)
+    for (size_t i = 0; i < order.size(); ++i)
+      if (!store[order[i]] && (m != ARC_BWTS || ents[b.idx[order[i]]].size <= arc_bwts_max))
+        tasks.push_back(order[i] * ARC_METHODS + m);
+  pool.run(tasks, [&](long t, int) {
+    long k = t / ARC_METHODS;
+    b.csize[t] = arc_code_method(codec, (int)(t % ARC_METHODS), &b.raw[k][0], (long)ents[b.idx[k]].size, b.cand[t]);
+  });
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    long k = order[i];
+    arc_entry &a = ents[b.idx[k]];
+
+    a.method = ARC_STORED;
+    a.csize = a.size;
+    for (int m = ARC_ARB255; m < ARC_METHODS; ++m) {
+      long c = b.csize[k * ARC_METHODS + m];
+      if (c >= 0 && (unsigned long long)c < a.csize) {
+        a.method = m;
+        a.csize = c;
+      }
+    }
+    if (a.method == ARC_STORED)
+      b.coded[k].assign(b.raw[k].begin(), b.raw[k].begin() + a.size);
+    else
+      b.coded[k].swap(b.cand[k * ARC_METHODS + a.method]);
+  }
+}
+
+int arc_create(msg_codec &codec, batch_io &io, int eng, int nthreads, const char *arcname, std::vector<arc_entry> &ents) {
+  work_pool pool(nthreads);
+  std::vector<long> todo;
+  std::vector<BYTE> dir;
+  unsigned long long next = 0, len;
+  size_t pos = 0;
+  int fd, errors = 0;
+
+  if ((fd = open(arcname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+    fprintf(stderr, "Could not write archive: %s\n", arcname);
+    return 2;
+  }
+  for (size_t i = 0; i < ents.size(); ++i)
+    todo.push_back((long)i);
+
+  arc_batches(
+      [&](arc_batch &b) {
+        arc_next_batch(b, todo, &pos, ents);
+        // One byte more than the stat size tells if the file has grown
+        for (size_t k = 0; k < b.idx.size(); ++k) {
+          arc_entry &a = ents[b.idx[k]];
+          b.raw[k].resize(a.size + 1);
+          b.io[k].name = a.name.c_str();
+          b.io[k].p = &b.raw[k][0];
+          b.io[k].len = (long)a.size + 1;
+        }
+        if (!b.idx.empty())
+          io.read_files(&b.io[0], (int)b.idx.size());
+        for (size_t k = 0; k < b.idx.size(); ++k) {
+          arc_entry &a = ents[b.idx[k]];
+          if (b.io[k].res == b.io[k].len && arc_read_file(a.name, b.raw[k], &a.size))
+            continue;
+          if (b.io[k].res < 0 || b.io[k].res == b.io[k].len) {
+            arc_error("Could not read", a.name);
+            a.size = 0;
+            b.bad[k] = 1;
+            ++errors;
+          } else {
+            a.size = b.io[k].res;
+          }
+        }
+      },
+      [&](arc_batch &b) {
+        if (eng == arc_best) {
+          arc_race(codec, pool, b, ents);
+          return;
+        }
+        pool.run(arc_order(b, ents), [&](long k, int) {
+          arc_entry &a = ents[b.idx[k]];
+          std::vector<BYTE> &c = b.coded[k];
+          long r;
+
+          if (c.size() < a.size + a.size / 4 + 64)
+            c.resize(a.size + a.size / 4 + 64);
+          while ((r = codec.encode(eng, &b.raw[k][0], (long)a.size, &c[0], (long)c.size())) > (long)c.size())
+            c.resize(r);
+          a.csize = r;
+        });
+      },
+      [&](arc_batch &b) {
+        for (size_t k = 0; k < b.idx.size(); ++k) {
+          arc_entry &a = ents[b.idx[k]];
+          if (b.bad[k])
+            a.csize = 0;
+          a.off = next;
+          next += a.csize;
+          b.io[k].p = a.csize ? &b.coded[k][0] : NULL;
+          b.io[k].len = (long)a.csize;
+          b.io[k].off = (off_t)a.off;
+        }
+        if (!b.idx.empty())
+          io.write_at(fd, &b.io[0], (int)b.idx.size());
+        for (size_t k = 0; k < b.idx.size(); ++k)
+          if (b.io[k].res != b.io[k].len) {
+            arc_error("Could not write archive", arcname);
+            ++errors;
+            break;
+          }
+      });
+
+  arc_pack(eng, ents, dir);
+  len = dir.size();
+  for (int i = 0; i < 8; ++i)
+    dir.push_back((BYTE)(len >> (8 * i)));
+  dir.insert(dir.end(), arc_magic, arc_magic + 8);
+  if (!arc_write_all(fd, &dir[0], dir.size(), (off_t)next) || close(fd) != 0) {
+    fprintf(stderr, "Could not write archive: %s\n", arcname);
+    return 2;
+  }
+  return errors ? 1 : 0;
+}
+
+// model_eng is the engine of the -p snapshot, -1 if there is none
+int arc_extract(msg_codec &codec, batch_io &io, int model_eng, int nthreads, const char *arcname, const char *dest) {
+  std::vector<arc_entry> ents;
+  std::vector<long> todo;
+  std::atomic<int> errors(0);
+  size_t pos = 0;
+  int fd, eng, r;
+
+  if ((fd = open(arcname, O_RDONLY)) < 0) {
+    fprintf(stderr, "Could not read archive: %s\n", arcname);
+    return 2;
+  }
+  if ((r = arc_read_dir(fd, &eng, ents)) != 0) {
+    close(fd);
+    return r;
+  }
+  if (model_eng >= 0 && model_eng != eng && eng != arc_best) {
+    fprintf(stderr, "Archive was made by %s, the model is for %s\n", eng_name[eng], eng_name[model_eng]);
+    close(fd);
+    return 2;
+  }
+
+  if (dest && chdir(dest) != 0) {
+    fprintf(stderr, "Could not enter directory: %s\n", dest);
+    close(fd);
+    return 2;
+  }
+  for (size_t i = 0; i < ents.size(); ++i) {
+    if (!arc_safe_name(ents[i].name)) {
+      arc_error("Skipping unsafe name", ents[i].name);
+      ++errors;
+      continue;
+    }
+    arc_make_dirs(ents[i].name);
+    todo.push_back((long)i);
+  }
+
+  work_pool pool(nthreads);
+
+  arc_batches(
+      [&](arc_batch &b) {
+        arc_next_batch(b, todo, &pos, ents);
+        for (size_t k = 0; k < b.idx.size(); ++k) {
+          arc_entry &a = ents[b.idx[k]];
+          b.coded[k].resize(a.csize + 1);
+          b.io[k].p = &b.coded[k][0];
+          b.io[k].len = (long)a.csize;
+          b.io[k].off = (off_t)a.off;
+        }
+        if (!b.idx.empty())
+          io.read_at(fd, &b.io[0], (int)b.idx.size());
+        for (size_t k = 0; k < b.idx.size(); ++k)
+          if (b.io[k].res != b.io[k].len) {
+            arc_error("Could not read archive data for", ents[b.idx[k]].name);
+            b.bad[k] = 1;
+            ++errors;
+          }
+      },
+      [&](arc_batch &b) {
+        pool.run(arc_order(b, ents), [&](long k, int) {
+          arc_entry &a = ents[b.idx[k]];
+          decode_budget limit; // A corrupt file stops at its size
+
+          try {
+            b.raw[k].resize(a.size + 1);
+          } catch (std::bad_alloc &) {
+            arc_error("Not enough memory for", a.name);
+            b.bad[k] = 1;
+            ++errors;
+            return;
+          }
+          limit.max_out = (long long)a.size;
+          limit.start((long long)a.csize);
+          bool ok = eng == arc_best ? arc_decode_method(codec, a.method, &b.coded[k][0], (long)a.csize,
+                                                        &b.raw[k][0], (long)a.size, &limit)
+                                    : codec.decode(eng, &b.coded[k][0], (long)a.csize, &b.raw[k][0], (long)a.size,
+                                                   &limit) == (long)a.size;
+          if (!ok || limit.over) {
+            arc_error("Does not decode to its size (wrong -p model?)", a.name);
+            b.bad[k] = 1;
+            ++errors;
+          }
+        });
+      },
+      [&](arc_batch &b) {
+        int n = 0;
+
+        for (size_t k = 0; k < b.idx.size(); ++k) {
+          if (b.bad[k])
+            continue;
+          b.io[n].name = ents[b.idx[k]].name.c_str();
+          b.io[n].p = &b.raw[k][0];
+          b.io[n].len = (long)ents[b.idx[k]].size;
+          ++n;
+        }
+        if (n)
+          io.write_files(&b.io[0], n);
+        for (int k = 0; k < n; ++k)
+          if (b.io[k].res != b.io[k].len) {
+            arc_error("Could not write", b.io[k].name);
+            ++errors;
+          }
+      });
+
+  close(fd);
+  return errors ? 1 : 0;
+}
+
+int arc_list(const char *arcname) {
+  std::vector<arc_entry> ents;
+  int fd, eng, r;
+
+  if ((fd = open(arcname, O_RDONLY)) < 0) {
+    fprintf(stderr, "Could not read archive: %s\n", arcname);
+    return 2;
+  }
+  if ((r = arc_read_dir(fd, &eng, ents)) == 0) {
+    printf("%s archive, %lu files\n", arc_eng_name(eng), (unsigned long)ents.size());
+    for (size_t i = 0; i < ents.size(); ++i)
+      if (eng == arc_best)
+        printf("%12llu %12llu  %-14s  %s\n", ents[i].size, ents[i].csize, arc_method_name[ents[i].method],
+               ents[i].name.c_str());
+      else
+        printf("%12llu %12llu  %s\n", ents[i].size, ents[i].csize, ents[i].name.c_str());
+  }
+  close(fd);
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  static model_prime start;
+  static msg_codec codec;
+  std::vector<arc_entry> ents;
+  const char *dest = NULL, *list = NULL, *model = NULL;
+  int a, eng = ENG_ARB255, nthreads = 0, iokind = IO_AUTO, r;
+  bool verbose = false;
+  batch_io io;
+  char mode;
+
+  if (argc < 3 || strlen(argv[1]) != 1 || !strchr("cxt", mode = argv[1][0])) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (a = 2; a < argc - 1 && argv[a][0] == '-'; ++a) {
+    if (strcmp(argv[a], "-e") == 0 && mode == 'c') {
+      if ((eng = strcmp(argv[++a], "best") == 0 ? arc_best : eng_find(argv[a])) < 0) {
+        fprintf(stderr, "Unknown engine: %s\n", argv[a]);
+        return 1;
+      }
+    } else if (strcmp(argv[a], "-j") == 0 && mode != 't') {
+      nthreads = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-I") == 0 && mode != 't') {
+      for (iokind = 2; iokind >= 0 && strcmp(argv[a + 1], io_name[iokind]); --iokind)
+        ;
+      if (iokind < 0) {
+        fprintf(stderr, "Unknown I/O backend: %s\n", argv[a + 1]);
+        return 1;
+      }
+      ++a;
+    } else if (strcmp(argv[a], "-v") == 0 && mode != 't') {
+      verbose = true;
+    } else if (strcmp(argv[a], "-p") == 0 && mode != 't') {
+      model = argv[++a];
+    } else if (strcmp(argv[a], "-T") == 0 && mode == 'c') {
+      list = argv[++a];
+    } else if (strcmp(argv[a], "-C") == 0 && mode == 'x') {
+      dest = argv[++a];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (a >= argc || (mode != 'c' && a != argc - 1)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (model) {
+    if (start.load(model)) {
+      fprintf(stderr, "Could not load model file: %s\n", model);
+      return 2;
+    }
+    if (mode == 'c' && start.eng != eng && eng != arc_best) {
+      fprintf(stderr, "Model file %s is for %s, not %s\n", model, eng_name[start.eng], eng_name[eng]);
+      return 2;
+    }
+    codec.prime(start);
+  }
+
+  if (mode == 't')
+    return arc_list(argv[a]);
+  if (io.open(iokind) < 0) {
+    fprintf(stderr, "io_uring is not available\n");
+    return 2;
+  }
+  if (mode == 'x') {
+    r = arc_extract(codec, io, model ? start.eng : -1, nthreads, argv[a], dest);
+    if (verbose)
+      fprintf(stderr, "%s: %ld system calls\n", io_name[io.kind], io.syscalls);
+    return r;
+  }
+
+  for (int i = a + 1; i < argc; ++i)
+    arc_add(argv[i], ents);
+  if (list) {
+    FILE *f = fopen(list, "r");
+    char line[4096];
+
+    if (f == NULL) {
+      fprintf(stderr, "Could not read file list: %s\n", list);
+      return 2;
+    }
+    while (fgets(line, sizeof(line), f)) {
+      line[strcspn(line, "\r\n")] = 0;
+      if (*line)
+        arc_add(line, ents);
+    }
+    fclose(f);
+  }
+  r = arc_create(codec, io, eng, nthreads, argv[a], ents);
+  if (verbose)
+    fprintf(stderr, "%s: %lu files, %ld system calls\n", io_name[io.kind], (unsigned long)ents.size(), io.syscalls);
+  return r;
+}
@@ -0,0 +1,120 @@
+/**
+ * arbc - Command line client of the arbd compression daemon
+ *
+ * A drop in for "arb255 c|d <infile> <outfile>" in scripts: the coding is
+ * done by a running arbd, so the output is the same as the file tools'.
+ * Use - for stdin/stdout.
+ *
+ * USAGE: arbc <socket> c|d [-e engine] <infile> <outfile>
+ *        arbc <socket> stats|stop
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "daemon.inc"
+#include "prime.inc"
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nClient of the arbd compression daemon\n");
+  fprintf(stderr, "USAGE: %s <socket> c|d [-e engine] <infile> <outfile>\n", progname);
+  fprintf(stderr, "       %s <socket> stats|stop\n\n", progname);
+  fprintf(stderr, "  c:  compress\n");
+  fprintf(stderr, "  d:  decompress\n");
+  fprintf(stderr, "  -e engine   arb255 or biacode (default arb255)\n");
+  fprintf(stderr, "  stats       print the daemon's counters and latency histograms\n");
+  fprintf(stderr, "  stop        shut the daemon down\n\n");
+}
+
+// Sends one request and reads the answer into out; returns the status or -1
+int request(int fd, int op, int eng, const std::vector<BYTE> &in, std::vector<BYTE> &out) {
+  unsigned long n;
+  int status;
+
+  if (!arbd_send(fd, op, eng, in.empty() ? NULL : &in[0], in.size()) || !arbd_recv_header(fd, &status, NULL, &n) ||
+      n > arbd_max_len)
+    return -1;
+  out.resize(n);
+  if (n && !arbd_read_all(fd, &out[0], n))
+    return -1;
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<BYTE> in, out;
+  struct sockaddr_un sa;
+  int a, fd, op, eng = ENG_ARB255, status;
+
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (strcmp(argv[2], "stats") == 0 && argc == 3) {
+    op = 's';
+  } else if (strcmp(argv[2], "stop") == 0 && argc == 3) {
+    op = 'q';
+  } else if ((strcmp(argv[2], "c") == 0 || strcmp(argv[2], "d") == 0) && argc >= 5) {
+    op = argv[2][0];
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (a = 3; a < argc - 2; ++a) {
+    if (strcmp(argv[a], "-e") == 0 && a + 1 < argc - 2 && (eng = eng_find(argv[++a])) >= 0)
+      continue;
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (op == 'c' || op == 'd') {
+    FILE *f = strcmp(argv[a], "-") ? fopen(argv[a], "rb") : stdin;
+    BYTE buf[65536];
+    size_t n;
+
+    if (f == NULL) {
+      fprintf(stderr, "Could not open input file: %s\n", argv[a]);
+      return 1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      in.insert(in.end(), buf, buf + n);
+    if (f != stdin)
+      fclose(f);
+  }
+
+  // A refused request is answered before the rest of it is read; get the answer
+  signal(SIGPIPE, SIG_IGN);
+  if (!arbd_address(argv[1], &sa) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    fprintf(stderr, "Could not connect to arbd at %s\n", argv[1]);
+    return 2;
+  }
+  status = request(fd, op, eng, in, out);
+  close(fd);
+
+  if (status < 0) {
+    fprintf(stderr, "Lost connection to arbd\n");
+    return 2;
+  }
+  if (status != ARBD_OK) {
+    fprintf(stderr, "arbd: %.*s\n", (int)out.size(), out.empty() ? "" : (const char *)&out[0]);
+    return 2;
+  }
+
+  if (op == 's') {
+    if (out.size())
+      fwrite(&out[0], 1, out.size(), stdout);
+  } else if (op != 'q') {
+    FILE *g = strcmp(argv[a + 1], "-") ? fopen(argv[a + 1], "wb") : stdout;
+
+    if (g == NULL || (out.size() && fwrite(&out[0], 1, out.size(), g) != out.size()) || fflush(g) != 0) {
+      fprintf(stderr, "Could not write output file: %s\n", argv[a + 1]);
+      return 2;
+    }
+    if (g != stdout)
+      fclose(g);
+  }
+  return 0;
+}
@@ -0,0 +1,339 @@
+/**
+ * arbd - Compression daemon on a Unix domain socket
+ *
+ * Serves compress/decompress requests (daemon.inc) for tools that would
+ * otherwise fork/exec "arb255 c" per request. Connections are handed to a
+ * fixed pool of worker threads; coding goes through one msg_codec whose
+ * coder/model pools are warmed for every worker at startup, so a request
+ * costs no process start and no model setup.
+ *
+ * Per engine and operation it counts requests, errors and bytes, and keeps
+ * a latency histogram with power of two buckets in microseconds. The 's'
+ * request (arbc ... stats) returns them as text.
+ *
+ * Any request is a valid compressed message, so decompression runs under
+ * a decode_budget (budget.inc): output is capped at the largest payload,
+ * and --max-ratio/--max-time can bound it further, so a hostile request
+ * holds a worker for a bounded time. The coders' sanity checks, which end
+ * the file tools, throw here instead and fail just that request.
+ *
+ * USAGE: arbd [-j workers] [-p model]... [--max-ratio x] [--max-time seconds] <socket>
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <string>
+#include <thread>
+#include "daemon.inc"
+#include "msgcodec.inc"
+
+typedef std::chrono::steady_clock arbd_clock;
+
+enum { HIST_BUCKETS = 32 };
+
+// Thrown by coder_fatal (bit_byts.inc) out of the coding of one request
+struct arbd_coder_error {};
+
+static void arbd_coder_fatal(void) { throw arbd_coder_error(); }
+
+// Counters of one engine and operation
+struct arbd_stat {
+  std::atomic<unsigned long long> requests, errors, bytes_in, bytes_out, usec;
+  std::atomic<unsigned long long> hist[HIST_BUCKETS]; // hist[k]: [2^k, 2^(k+1)) us, hist[0] also < 1 us
+
+  arbd_stat() : requests(0), errors(0), bytes_in(0), bytes_out(0), usec(0) {
+    for (int k = 0; k < HIST_BUCKETS; ++k)
+      hist[k] = 0;
+  }
+
+  void add(double us, unsigned long in, unsigned long out, bool ok) {
+    unsigned long long u = (unsigned long long)us;
+    int k = 0;
+
+    while (k < HIST_BUCKETS - 1 && (u >> (k + 1)))
+      ++k;
+    hist[k]++;
+    requests++;
+    if (!ok)
+      errors++;
+    bytes_in += in;
+    bytes_out += out;
+    usec += u;
+  }
+
+  // Upper bound of the bucket holding the p quantile, in us
+  unsigned long long quantile(double p) const {
+    unsigned long long n = requests, seen = 0;
+
+    for (int k = 0; k < HIST_BUCKETS; ++k)
+      if ((seen += hist[k]) > 0 && seen >= p * n)
+        return 2ULL << k;
+    return 0;
+  }
+};
+
+struct arbd_server {
+  msg_codec codec;
+  decode_budget limits; // Budget of each decompression
+  arbd_stat stat[ENG_COUNT][2]; // [engine][0 compress, 1 decompress]
+  arbd_clock::time_point started;
+  int lfd;
+  const char *path;
+  std::atomic<bool> stopping;
+
+  std::mutex lock;
+  std::condition_variable ready;
+  std::deque<int> conns; // Accepted connections waiting for a worker
+  std::set<int> clients; // Open connections, queued or served
+
+  arbd_server() : lfd(-1), path(NULL), stopping(false) {}
+
+  std::string report() {
+    static const char *opname[2] = {"compress", "decompress"};
+    double up = std::chrono::duration<double>(arbd_clock::now() - started).count();
+    std::string s;
+    char line[256];
+
+    snprintf(line, sizeof(line), "uptime %.1f s\n", up);
+    s += line;
+    for (int e = 0; e < ENG_COUNT; ++e) {
+      for (int o = 0; o < 2; ++o) {
+        arbd_stat &st = stat[e][o];
+        unsigned long long n = st.requests;
+
+        snprintf(line, sizeof(line),
+                 "%s %s: requests %llu errors %llu in %llu out %llu MB/s %.2f mean %.1fus p50 <%lluus p99 <%lluus\n",
+                 eng_name[e], opname[o], n, (unsigned long long)st.errors, (unsigned long long)st.bytes_in,
+                 (unsigned long long)st.bytes_out, st.usec ? st.bytes_in / (double)st.usec : 0.0,
+                 n ? (double)st.usec / n : 0.0, st.quantile(0.5), st.quantile(0.99));
+        s += line;
+        if (!n)
+          continue;
+        s += "  histogram us:";
+        for (int k = 0; k < HIST_BUCKETS; ++k) {
+          if (!st.hist[k])
+            continue;
+          snprintf(line, sizeof(line), " <%llu:%llu", 2ULL << k, (unsigned long long)st.hist[k]);
+          s += line;
+        }
+        s += "\n";
+      }
+    }
+    return s;
+  }
+
+  void stop() {
+    stopping = true;
+    shutdown(lfd, SHUT_RDWR);
+  }
+
+  /**
+   * Serve the requests of one connection until the client closes it
+   */
+  void serve(int fd, std::vector<BYTE> &in, std::vector<BYTE> &out) {
+    unsigned long n;
+    int op, eng;
+
+    while (arbd_recv_header(fd, &op, &eng, &n)) {
+      if (n > arbd_max_len) {
+        static const char msg[] = "request too big";
+        arbd_send(fd, ARBD_TOO_BIG, -1, msg, sizeof(msg) - 1);
+        break;
+      }
+      if (in.size() < n + 1)
+        in.resize(n + 1);
+      if (!arbd_read_all(fd, &in[0], n))
+        break;
+
+      if (op == 's') {
+        std::string s = report();
+        if (!arbd_send(fd, ARBD_OK, -1, s.data(), s.size()))
+          break;
+        continue;
+      }
+      if (op == 'q') {
+        arbd_send(fd, ARBD_OK, -1, NULL, 0);
+        stop();
+        break;
+      }
+      if ((op != 'c' && op != 'd') || eng >= ENG_COUNT) {
+        static const char msg[] = "unknown operation or engine";
+        if (!arbd_send(fd, ARBD_BAD_REQUEST, -1, msg, sizeof(msg) - 1))
+          break;
+        continue;
+      }
+
+      arbd_clock::time_point t0 = arbd_clock::now();
+      decode_budget budget = limits;
+      long r;
+
+      budget.start((long long)n);
+      if (out.size() < n + n / 4 + 64)
+        out.resize(n + n / 4 + 64);
+      try {
+        while ((r = codec.code(eng, op == 'd', &in[0], (long)n, &out[0], (long)out.size(),
+                               op == 'd' ? &budget : NULL)) > (long)out.size() &&
+               (unsigned long)r <= arbd_max_len && !budget.over)
+          out.resize(r);
+      } catch (arbd_coder_error &) {
+        static const char msg[] = "coder error";
+        stat[eng][op == 'd'].add(std::chrono::duration<double, std::micro>(arbd_clock::now() - t0).count(), n, 0,
+                                 false);
+        if (!arbd_send(fd, ARBD_BAD_REQUEST, -1, msg, sizeof(msg) - 1))
+          break;
+        continue;
+      }
+
+      bool ok = (unsigned long)r <= arbd_max_len && !budget.over;
+      stat[eng][op == 'd'].add(std::chrono::duration<double, std::micro>(arbd_clock::now() - t0).count(), n,
+                               ok ? r : 0, ok);
+      if (!ok && budget.over != BUDGET_RATIO && budget.over != BUDGET_TIME) {
+        static const char msg[] = "output too big";
+        if (!arbd_send(fd, ARBD_TOO_BIG, -1, msg, sizeof(msg) - 1))
+          break;
+      } else if (!ok) {
+        char msg[64];
+        int k = snprintf(msg, sizeof(msg), "decompression over its %s limit", budget.over_name());
+        if (!arbd_send(fd, ARBD_OVER_BUDGET, -1, msg, k))
+          break;
+      } else if (!arbd_send(fd, ARBD_OK, -1, r ? &out[0] : NULL, r)) {
+        break;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> g(lock);
+      clients.erase(fd);
+    }
+    close(fd);
+  }
+
+  void worker() {
+    std::vector<BYTE> in, out;
+
+    for (;;) {
+      int fd;
+      {
+        std::unique_lock<std::mutex> g(lock);
+        while (conns.empty() && !stopping)
+          ready.wait(g);
+        if (conns.empty())
+          return;
+        fd = conns.front();
+        conns.pop_front();
+      }
+      serve(fd, in, out);
+    }
+  }
+
+  void accept_loop() {
+    int fd;
+
+    while (!stopping) {
+      if ((fd = accept(lfd, NULL, NULL)) < 0) {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        break;
+      }
+      std::lock_guard<std::mutex> g(lock);
+      conns.push_back(fd);
+      clients.insert(fd);
+      ready.notify_one();
+    }
+    // Idle clients would keep their workers in serve(): end their reads
+    std::lock_guard<std::mutex> g(lock);
+    stopping = true;
+    for (std::set<int>::iterator i = clients.begin(); i != clients.end(); ++i)
+      shutdown(*i, SHUT_RDWR);
+    ready.notify_all();
+  }
+};
+
+static arbd_server server;
+
+static void on_signal(int) { server.stop(); }
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nCompression daemon for arb255 and biacode\n");
+  fprintf(stderr, "USAGE: %s [-j workers] [-p model]... [--max-ratio x] [--max-time seconds] <socket>\n\n",
+          progname);
+  fprintf(stderr, "  -j workers          connections served at once (default one per CPU, at least 2)\n");
+  fprintf(stderr, "  -p model            start messages from a snapshot made by mkprime (one per engine)\n");
+  fprintf(stderr, "  --max-ratio x       refuse to decompress to more than x times the request size\n");
+  fprintf(stderr, "  --max-time seconds  refuse decompressions that take longer than this\n\n");
+  fprintf(stderr, "Talk to it with arbc. SIGINT/SIGTERM or \"arbc <socket> stop\" shut it down.\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  static model_prime mp;
+  struct sockaddr_un sa;
+  int a, nworkers = 0;
+
+  for (a = 1; a < argc - 1 && argv[a][0] == '-'; ++a) {
+    if (strcmp(argv[a], "-j") == 0 && a + 1 < argc - 1) {
+      nworkers = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-p") == 0 && a + 1 < argc - 1) {
+      if (mp.load(argv[++a])) {
+        fprintf(stderr, "Could not load model file: %s\n", argv[a]);
+        return 2;
+      }
+      server.codec.prime(mp);
+    } else if ((strcmp(argv[a], "--max-ratio") == 0 || strcmp(argv[a], "--max-time") == 0) && a + 1 < argc - 1) {
+      if (!budget_parse(argv[a], argv[a + 1], &server.limits)) {
+        fprintf(stderr, "Bad %s \"%s\", expected a number above 0\n", argv[a], argv[a + 1]);
+        return 1;
+      }
+      ++a;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (a != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  server.limits.max_out = arbd_max_len;
+  if (nworkers < 1)
+    nworkers = (int)std::thread::hardware_concurrency();
+  if (nworkers < 2)
+    nworkers = 2;
+
+  server.path = argv[a];
+  if (!arbd_address(server.path, &sa)) {
+    fprintf(stderr, "Socket path too long: %s\n", server.path);
+    return 1;
+  }
+  unlink(server.path);
+  if ((server.lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(server.lfd, (struct sockaddr *)&sa, sizeof(sa)) != 0 ||
+      listen(server.lfd, 128) != 0) {
+    fprintf(stderr, "Could not listen on %s: %s\n", server.path, strerror(errno));
+    return 2;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  coder_fatal = arbd_coder_fatal;
+
+  server.codec.warm(nworkers);
+  server.started = arbd_clock::now();
+
+  std::vector<std::thread> th;
+  for (int i = 0; i < nworkers; ++i)
+    th.push_back(std::thread(&arbd_server::worker, &server));
+  server.accept_loop();
+  for (size_t i = 0; i < th.size(); ++i)
+    th[i].join();
+
+  close(server.lfd);
+  unlink(server.path);
+  fputs(server.report().c_str(), stderr);
+  return 0;
+}
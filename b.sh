@@ -4,7 +4,43 @@ set -e
 echo "Building arb255..."
 g++ -o arb255 arb255.cpp
 
+echo "Building unarb255..."
+g++ -o unarb255 unarb255.cpp
+
 echo "Building biacode..."
 g++ -o biacode biacode.cpp
 
+echo "Building mkprime..."
+g++ -o mkprime mkprime.cpp
+
+echo "Building msgbench..."
+g++ -O2 -o msgbench msgbench.cpp
+
+echo "Building arbar..."
+g++ -O2 -pthread -o arbar arbar.cpp
+
+echo "Building arbd, arbc..."
+g++ -O2 -pthread -o arbd arbd.cpp
+g++ -O2 -o arbc arbc.cpp
+
+echo "Building ringbench..."
+g++ -O2 -o ringbench ringbench.cpp
+
+echo "Building bwtsbench..."
+g++ -O2 -pthread -o bwtsbench bwtsbench.cpp
+
+echo "Building bijcheck..."
+g++ -O2 -pthread -o bijcheck bijcheck.cpp
+
+echo "Building slowfuzz..."
+g++ -O2 -o slowfuzz slowfuzz.cpp
+
+echo "Building iocheck..."
+g++ -O2 -o iocheck iocheck.cpp
+
+echo "Building phase profiled arb255, unarb255, biacode..."
+g++ -O2 -DARB_PROFILE -o arb255_prof arb255.cpp
+g++ -O2 -DARB_PROFILE -o unarb255_prof unarb255.cpp
+g++ -O2 -DARB_PROFILE -o biacode_prof biacode.cpp
+
 echo "Build completed successfully!"
@@ -4,615 +4,18 @@
 //  For commercial purposes, mail me at matt@timmermans.org, and we'll talk.
 //===========================================================================
 
-#include <assert.h>
 #include <fstream>
 #include <iostream>
-#include <istream>
-#include <ostream>
 #include <sstream>
-#include <streambuf>
-
-//===========================================================================
-// Type definitions and constants
-//===========================================================================
-
-typedef unsigned long U32;
-typedef unsigned char BYTE;
-
-static const U32 MAXP1 = 0x08000L;
-static const U32 BIT16 = 0x10000L;
-static const U32 MASK16 = 0x0FFFFL;
-
-//===========================================================================
-// ArithmeticModel - Base class for probability models
-//===========================================================================
-
-class ArithmeticModel {
-public:
-  U32 ProbOne() const { return prob1; }
-  virtual void GetSymRange(int symbol, U32 *newlow, U32 *newhigh) const = 0;
-  virtual int GetSymbol(U32 p, U32 *newlow, U32 *newhigh) const = 0;
-
-protected:
-  U32 prob1;
-};
-
-//===========================================================================
-// BytesAsFOBitsOutBuf - Output stream buffer for finitely-odd bit streams
-//===========================================================================
-
-class BytesAsFOBitsOutBuf : public std::streambuf {
-public:
-  BytesAsFOBitsOutBuf(std::ostream &bytestream, int bytesperblock = 1) : base(bytestream), segsize(0), reserve0(false), segfirst(0) {
-    blocksize = (bytesperblock > 0 ? bytesperblock : 1);
-    blockleft = 0;
-  }
-
-  ~BytesAsFOBitsOutBuf() { End(); }
-
-  void End() {
-    sync();
-
-    if (!segsize)
-      segfirst = 0;
-
-  TOP:
-    for (; blockleft; --blockleft) {
-      reserve0 = reserve0 && !segfirst;
-      base.put(segfirst ^ 55);
-      segfirst = 0;
-    }
-
-    if (reserve0) {
-      assert(segfirst != 0);
-      if (segfirst != (char)128) {
-        reserve0 = false;
-        blockleft = blocksize;
-        goto TOP;
-      }
-    } else if (segfirst) {
-      blockleft = blocksize;
-      goto TOP;
-    }
-
-    segsize = 0;
-    reserve0 = false;
-    blockleft = 0;
-  }
-
-private:
-  std::ostream &base;
-  long segsize;
-  int blocksize, blockleft;
-  char buf[256];
-  char segfirst;
-  bool reserve0;
-
-  virtual int overflow(int c) {
-    char *s, *e;
-
-    for (s = pbase(), e = pptr(); s != e; ++s) {
-      if (!segsize) {
-        segfirst = *s;
-        ++segsize;
-      } else if (!*s) {
-        ++segsize;
-      } else {
-        if (!blockleft) {
-          if (reserve0)
-            reserve0 = !(segfirst & 127);
-          else
-            reserve0 = !segfirst;
-          blockleft = blocksize - 1;
-        } else {
-          reserve0 = reserve0 && !segfirst;
-          --blockleft;
-        }
-
-        base.put(segfirst ^ 55);
-
-        for (--segsize; segsize; --segsize) {
-          if (!blockleft) {
-            reserve0 = true;
-            blockleft = blocksize - 1;
-          } else {
-            --blockleft;
-          }
-          base.put(55);
-        }
-
-        segfirst = *s;
-        ++segsize;
-      }
-    }
-
-    buf[0] = (char)c;
-    setp(buf, buf + 256);
-    if (c >= 0)
-      pbump(1);
-
-    return (c & 255);
-  }
-
-  virtual int sync() {
-    overflow(-1);
-    return 0;
-  }
-};
-
-//===========================================================================
-// BytesAsFOBitsInBuf - Input stream buffer for finitely-odd bit streams
-//===========================================================================
-
-class BytesAsFOBitsInBuf : public std::streambuf {
-public:
-  BytesAsFOBitsInBuf(std::istream &bytestream, int bytesperblock = 1) : base(bytestream), blockleft(0), in_done(false), reserve0(false) {
-    blocksize = (bytesperblock > 0 ? bytesperblock : 1);
-    blockleft = 0;
-  }
-
-private:
-  std::istream &base;
-  int blocksize, blockleft;
-  bool in_done;
-  bool reserve0;
-  char buf[256];
-
-  virtual int underflow() {
-    char *s, *e;
-    int inbyte;
-
-    for (s = buf, e = buf + 256; (s != e); ++s) {
-      if (in_done) {
-        inbyte = 0;
-      } else {
-        inbyte = base.get();
-        if (inbyte < 0) {
-          in_done = true;
-          inbyte = 0;
-        } else {
-          inbyte ^= 55;
-        }
-      }
-
-      if (blockleft) {
-        reserve0 = reserve0 && !inbyte;
-        *s = (char)inbyte;
-        --blockleft;
-      } else if (in_done) {
-        if (reserve0) {
-          *s = (char)128;
-          reserve0 = false;
-        } else {
-          break;
-        }
-      } else {
-        if (reserve0)
-          reserve0 = !(inbyte & 127);
-        else
-          reserve0 = !inbyte;
-        blockleft = blocksize - 1;
-        *s = (char)inbyte;
-      }
-    }
-
-    if (s > buf) {
-      setg(buf, buf, s);
-      return (unsigned char)buf[0];
-    } else {
-      setg(0, 0, 0);
-      return -1;
-    }
-  }
-};
-
-//===========================================================================
-// FOBitOStream and FOBitIStream - Finitely-odd bit stream classes
-//===========================================================================
-
-typedef std::ostream stdostream;
-typedef std::istream stdistream;
-
-class FOBitOStream : public stdostream {
-public:
-  FOBitOStream(std::ostream &base, int blocksize = 1) : stdostream(&buffer), buffer(base, blocksize) {}
-  void End() { buffer.End(); }
-
-private:
-  BytesAsFOBitsOutBuf buffer;
-};
-
-class FOBitIStream : public stdistream {
-public:
-  FOBitIStream(std::istream &base, int blocksize = 1) : stdistream(&buffer), buffer(base, blocksize) {}
-
-private:
-  BytesAsFOBitsInBuf buffer;
-};
-
-//===========================================================================
-// ArithmeticEncoder - Bijective Arithmetic Encoder
-//===========================================================================
-
-class ArithmeticEncoder {
-public:
-  ArithmeticEncoder(std::ostream &outstream) : bytesout(outstream) {
-    low = 0;
-    range = BIT16;
-    intervalbits = 16;
-    freeendeven = MASK16;
-    nextfreeend = 0;
-    carrybyte = 0;
-    carrybuf = 0;
-  }
-
-  void Encode(const ArithmeticModel *model, int symbol, bool could_have_ended) {
-    U32 newh, newl;
-
-    if (could_have_ended) {
-      if (nextfreeend)
-        nextfreeend += (freeendeven + 1) << 1;
-      else
-        nextfreeend = freeendeven + 1;
-    }
-
-    model->GetSymRange(symbol, &newl, &newh);
-    newl = newl * range / model->ProbOne();
-    newh = newh * range / model->ProbOne();
-    range = newh - newl;
-    low += newl;
-
-    if (nextfreeend < low)
-      nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-
-    if (range <= (BIT16 >> 1)) {
-      low += low;
-      range += range;
-      nextfreeend += nextfreeend;
-      freeendeven += freeendeven + 1;
-
-      while (nextfreeend - low >= range) {
-        freeendeven >>= 1;
-        nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-      }
-
-      for (;;) {
-        if (++intervalbits == 24) {
-          newl = low & ~MASK16;
-          low -= newl;
-          nextfreeend -= newl;
-          freeendeven &= MASK16;
-          ByteWithCarry(newl >> 16);
-          intervalbits -= 8;
-        }
-
-        if (range > (BIT16 >> 1))
-          break;
-
-        low += low;
-        range += range;
-        nextfreeend += nextfreeend;
-        freeendeven += freeendeven + 1;
-      }
-      while (range <= (BIT16 >> 1))
-        ;
-    } else {
-      while (nextfreeend - low >= range) {
-        freeendeven >>= 1;
-        nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-      }
-    }
-  }
-
-  void End() {
-    nextfreeend <<= (24 - intervalbits);
-
-    while (nextfreeend) {
-      ByteWithCarry(nextfreeend >> 16);
-      nextfreeend = (nextfreeend & MASK16) << 8;
-    }
-
-    if (carrybuf)
-      ByteWithCarry(0);
-
-    low = 0;
-    range = BIT16;
-    intervalbits = 16;
-    freeendeven = MASK16;
-    nextfreeend = 0;
-    carrybyte = 0;
-    carrybuf = 0;
-  }
-
-private:
-  void ByteWithCarry(U32 outbyte) {
-    if (carrybuf) {
-      if (outbyte >= 256) {
-        bytesout.put((char)(carrybyte + 1));
-        while (--carrybuf)
-          bytesout.put(0);
-        carrybyte = (BYTE)outbyte;
-      } else if (outbyte < 255) {
-        bytesout.put((char)carrybyte);
-        while (--carrybuf)
-          bytesout.put((char)255);
-        carrybyte = (BYTE)outbyte;
-      }
-    } else {
-      carrybyte = (BYTE)outbyte;
-    }
-    ++carrybuf;
-  }
-
-  std::ostream &bytesout;
-  U32 low, range;
-  int intervalbits;
-  U32 freeendeven;
-  U32 nextfreeend;
-  BYTE carrybyte;
-  unsigned long carrybuf;
-};
-
-//===========================================================================
-// ArithmeticDecoder - Bijective Arithmetic Decoder
-//===========================================================================
-
-class ArithmeticDecoder {
-public:
-  ArithmeticDecoder(std::istream &instream) : bytesin(instream) {
-    low = 0;
-    range = BIT16;
-    intervalbits = 16;
-    freeendeven = MASK16;
-    nextfreeend = 0;
-    value = 0;
-    valueshift = -24;
-    followbyte = 0;
-    followbuf = 1;
-  }
-
-  int Decode(const ArithmeticModel *model, bool can_end) {
-    int ret;
-    U32 newh, newl;
-
-    while (valueshift <= 0) {
-      value <<= 8;
-      valueshift += 8;
-
-      if (!--followbuf) {
-        value |= followbyte;
-
-        int cin;
-        do {
-          cin = bytesin.get();
-          if (cin < 0) {
-            followbuf = -1;
-            break;
-          }
-          ++followbuf;
-          followbyte = (BYTE)cin;
-        } while (!followbyte);
-      }
-    }
-
-    if (can_end) {
-      if ((followbuf < 0) && (((nextfreeend - low) << valueshift) == value))
-        return -1;
-
-      if (nextfreeend)
-        nextfreeend += (freeendeven + 1) << 1;
-      else
-        nextfreeend = freeendeven + 1;
-    }
-
-    newl = ((value >> valueshift) * model->ProbOne() + model->ProbOne() - 1) / range;
-    ret = model->GetSymbol(newl, &newl, &newh);
-
-    newl = newl * range / model->ProbOne();
-    newh = newh * range / model->ProbOne();
-
-    range = newh - newl;
-    value -= (newl << valueshift);
-    low += newl;
-
-    if (nextfreeend < low)
-      nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-
-    if (range <= (BIT16 >> 1)) {
-      low += low;
-      range += range;
-      nextfreeend += nextfreeend;
-      freeendeven += freeendeven + 1;
-      --valueshift;
-
-      while (nextfreeend - low >= range) {
-        freeendeven >>= 1;
-        nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-      }
-
-      for (;;) {
-        if (++intervalbits == 24) {
-          newl = low & ~MASK16;
-          low -= newl;
-          nextfreeend -= newl;
-          freeendeven &= MASK16;
-          intervalbits -= 8;
-        }
-
-        if (range > (BIT16 >> 1))
-          break;
-
-        low += low;
-        range += range;
-        nextfreeend += nextfreeend;
-        freeendeven += freeendeven + 1;
-        --valueshift;
-      }
-      while (range <= (BIT16 >> 1))
-        ;
-    } else {
-      while (nextfreeend - low >= range) {
-        freeendeven >>= 1;
-        nextfreeend = ((low + freeendeven) & ~freeendeven) | (freeendeven + 1);
-      }
-    }
-
-    return ret;
-  }
-
-private:
-  std::istream &bytesin;
-  U32 low, range;
-  int intervalbits;
-  U32 freeendeven;
-  U32 nextfreeend;
-  U32 value;
-  int valueshift;
-  BYTE followbyte;
-  long followbuf;
-};
-
-//===========================================================================
-// SimpleAdaptiveModel - Adaptive probability model
-//===========================================================================
-
-class SimpleAdaptiveModel : public ArithmeticModel {
-public:
-  SimpleAdaptiveModel(int numsymbols) {
-    int i;
-
-    for (symzeroindex = 1; symzeroindex < numsymbols; symzeroindex += symzeroindex)
-      ;
-
-    probheap = new U32[symzeroindex << 1];
-    for (i = symzeroindex << 1; i--;)
-      probheap[i] = 0;
-    prob1 = 0;
-
-    for (i = numsymbols; i--;)
-      AddP(i, 1);
-
-    for (i = 4096; i--;)
-      window[i] = -1;
-
-    w0 = window;
-    w1 = w0 + 1024;
-    w2 = w0 + 2048;
-    w3 = w0 + 3072;
-  }
-
-  ~SimpleAdaptiveModel() { delete[] probheap; }
-
-  void Update(int symbol) {
-    w1 = ((w1 == window) ? w1 + 4095 : w1 - 1);
-    if (*w1 >= 0)
-      SubP(*w1, 2);
-
-    w2 = ((w2 == window) ? w2 + 4095 : w2 - 1);
-    if (*w2 >= 0)
-      SubP(*w2, 1);
-
-    w3 = ((w3 == window) ? w3 + 4095 : w3 - 1);
-    if (*w3 >= 0)
-      SubP(*w3, 1);
-
-    w0 = ((w0 == window) ? w0 + 4095 : w0 - 1);
-    if (*w0 >= 0)
-      SubP(*w0, 2);
-
-    *w0 = symbol;
-    AddP(symbol, 6);
-  }
-
-  void Reset() {
-    int *w, *lim;
-    lim = window + 4095;
-
-    for (w = w0; w != w1; w = (w == lim ? window : w + 1)) {
-      if (*w < 0)
-        goto DONE;
-      SubP(*w, 6);
-      *w = -1;
-    }
-
-    for (w = w1; w != w2; w = (w == lim ? window : w + 1)) {
-      if (*w < 0)
-        goto DONE;
-      SubP(*w, 4);
-      *w = -1;
-    }
-
-    for (w = w2; w != w3; w = (w == lim ? window : w + 1)) {
-      if (*w < 0)
-        goto DONE;
-      SubP(*w, 3);
-      *w = -1;
-    }
-
-    for (w = w3; w != w0; w = (w == lim ? window : w + 1)) {
-      if (*w < 0)
-        goto DONE;
-      SubP(*w, 2);
-      *w = -1;
-    }
-
-  DONE:
-    return;
-  }
-
-  virtual void GetSymRange(int symbol, U32 *newlow, U32 *newhigh) const {
-    int i, bit = symzeroindex;
-    U32 low = 0;
-
-    for (i = 1; i < symzeroindex;) {
-      bit >>= 1;
-      i += i;
-
-      if (symbol & bit) {
-        low += probheap[i++];
-      }
-    }
-
-    *newlow = low;
-    *newhigh = low + probheap[i];
-  }
-
-  virtual int GetSymbol(U32 p, U32 *newlow, U32 *newhigh) const {
-    int i;
-    U32 low = 0;
-
-    for (i = 1; i < symzeroindex;) {
-      i += i;
-
-      if ((p - low) >= probheap[i]) {
-        low += probheap[i++];
-      }
-    }
-
-    *newlow = low;
-    *newhigh = low + probheap[i];
-    return (i - symzeroindex);
-  }
-
-private:
-  void AddP(int sym, U32 n) {
-    for (sym += symzeroindex; sym; sym >>= 1)
-      probheap[sym] += n;
-
-    prob1 = probheap[1];
-  }
-
-  void SubP(int sym, U32 n) {
-    for (sym += symzeroindex; sym; sym >>= 1)
-      probheap[sym] -= n;
-
-    prob1 = probheap[1];
-  }
-
-  U32 *probheap;
-  int symzeroindex;
-  int window[4096], *w0, *w1, *w2, *w3;
-};
+#include <thread>
+#include "biacode.inc"
+#include "budget.inc"
+#include "bwts.inc"
+#include "estimate.inc"
+#include "pipeline.inc"
+#include "prime.inc"
+#include "seekable.inc"
+#include "shuffle.inc"
 
 static char *_callname;
 
@@ -630,18 +33,139 @@ int usage() {
     ;
 
   cerr << endl << "Bijective arithmetic encoder V1.2" << endl << "Copyright (C) 1999, Matt Timmermans" << endl << endl;
-  cerr << "USAGE: " << s << " c|d <infile> <outfile>" << endl << endl;
+  cerr << "USAGE: " << s << " c|d [options] <infile> <outfile>" << endl;
+  cerr << "       " << s << " e [-p model] [-t w[d|x]] [-w KB] [-S percent] <infile>" << endl << endl;
   cerr << "  c:  compress" << endl;
-  cerr << "  d:  decompress" << endl << endl;
+  cerr << "  d:  decompress" << endl;
+  cerr << "  e:  estimate the compressed size from the model alone, without coding" << endl;
+  cerr << "  -a:              read ahead and write behind on separate threads" << endl;
+  cerr << "  -z:              like -a, output to a pipe or socket goes by vmsplice/splice" << endl;
+  cerr << "  -b bytes:        code in blocks of this many bytes, e.g. 4096 (same for c and d)" << endl;
+  cerr << "  -D:              like -a, write the output file with O_DIRECT" << endl;
+  cerr << "  -w KB:           bijective BWT + move-to-front in blocks of KB (same for c and d)" << endl;
+  cerr << "  -j threads:      threads for the -w blocks (default: all cores)" << endl;
+  cerr << "  -r:              bijective run-length stage in front of the coder (same for c and d)" << endl;
+  cerr << "  -t w[d|x]:        shuffle bytes of w = 2, 4 or 8 byte numbers into planes, d: delta" << endl;
+  cerr << "                    first, x: xor delta first (same for c and d)" << endl;
+  cerr << "  -p model:        start from a model snapshot made by mkprime (same for c and d)" << endl;
+  cerr << "  -s:              seekable container of independently coded frames" << endl;
+  cerr << "  -f bytes:        frame size for -s (default 1048576)" << endl;
+  cerr << "  -i file:         keep the -s frame index in a sidecar file instead of a trailer" << endl;
+  cerr << "  --range off:len: decode only this part of a -s container (len empty: to the end)" << endl;
+  cerr << "  -S percent:      for e, look at only this part of the input, spread over it" << endl;
+  cerr << "  --max-out bytes, --max-ratio x, --max-time seconds:" << endl;
+  cerr << "                   for d, stop when the output passes this size, this many times the" << endl;
+  cerr << "                   input size or this time; the output so far is kept (exit code 3);" << endl;
+  cerr << "                   not with -s, -r, -w or -t" << endl << endl;
   return 100;
 }
 
+/**
+ * Code in to out with model, which must be freshly set up. Decoding stops
+ * early when the budget, if any, runs out.
+ */
+static void Code(istream &in, ostream &out, SimpleAdaptiveModel &model, bool decomp, int blocksize,
+                 decode_budget *budget) {
+  int sym;
+
+  if (decomp) {
+    // DECOMPRESSION MODE
+    // Algorithm: Bijective arithmetic decoding
+    // - Reads a finitely-odd bit stream (stream ending with final 1, then infinite 0s)
+    // - Uses arithmetic decoder to map bit stream back to symbol probabilities
+    // - Adaptive model updates probabilities after each symbol
+    // - Decoding stops when special end-of-stream marker is encountered
+
+    FOBitIStream inbits(in, blocksize);
+    ArithmeticDecoder decoder(inbits);
+    long long bits = 0, stop = decode_budget::first(budget);
+
+    for (;;) {
+      // Decode next symbol using current probability model
+      // The 'true' parameter indicates this could be end-of-stream
+      PROF_SYMBOL(PROF_IO);
+      sym = decoder.Decode(&model, true);
+      if (sym < 0)
+        break; // End of stream
+
+      // Output bits so far against the budget, looked at once per step
+      if ((bits += 8) >= stop && (stop = budget->check(bits)) < 0)
+        break;
+
+      PROF_PHASE(PROF_IO);
+      out.put((char)(sym));
+
+      // Update model with decoded symbol for adaptive compression
+      PROF_PHASE(PROF_MODEL);
+      model.Update(sym);
+    }
+  } else {
+    // COMPRESSION MODE
+    // Algorithm: Bijective arithmetic encoding
+    // - Maps input byte stream to a finitely-odd bit stream
+    // - Uses arithmetic encoder to narrow probability intervals
+    // - Each symbol narrows the interval based on its probability
+    // - Adaptive model updates probabilities to match input statistics
+    // - Bijection ensures unique reversible encoding (no ambiguity)
+
+    FOBitOStream outbits(out, blocksize);
+    ArithmeticEncoder encoder(outbits);
+
+    for (;;) {
+      PROF_SYMBOL(PROF_IO);
+      sym = in.get();
+      if (sym < 0)
+        break; // End of input
+
+      // Encode symbol into the probability interval
+      // The 'true' parameter reserves a "free end" for potential stream termination
+      encoder.Encode(&model, sym, true);
+
+      // Update model with encoded symbol for adaptive compression
+      PROF_PHASE(PROF_MODEL);
+      model.Update(sym);
+    }
+
+    // Finalize encoding by writing the "free end" terminator
+    encoder.End();
+    outbits.End();
+  }
+}
+
+/**
+ * Report a decode cut short by its budget; returns the exit code, 3 if it
+ * was
+ */
+static int BudgetReport(const decode_budget &budget) {
+  if (!budget.over)
+    return 0;
+  cerr << "Decoding stopped by the " << budget.over_name() << " limit after " << budget.out
+       << " output bytes, " << budget.seconds() << " s" << endl;
+  return 3;
+}
+
 static int Test();
 
 int main(int argc, char **argv) {
   char *s;
   bool decomp = false;
   int blocksize = 1;
+  static model_prime start;
+  bool primed = false;
+  bool seekable = false;
+  bool async = false;
+  bool zerocopy = false;
+  bool direct = false;
+  bool rle = false;
+  shuffle_spec shufspec, *shuf = NULL;
+  long block = 0;
+  int threads = (int)std::thread::hardware_concurrency();
+  long framesize = 1L << 20;
+  long long off = 0, len = -1;
+  const char *sidename = NULL;
+  bool estimate = false;
+  int nfiles = 2, percent = 100;
+  decode_budget budget;
 
   // Parse program name
   if (argc) {
@@ -651,8 +175,9 @@ int main(int argc, char **argv) {
     _callname = "biacode";
   }
 
-  // Require exactly 3 arguments: mode, input file, output file
-  if (argc != 3)
+  // Require at least 2 arguments: mode, [options], input file, output file
+  // (no output file for e)
+  if (argc < 2)
     return usage();
 
   // Parse compression mode
@@ -661,86 +186,265 @@ int main(int argc, char **argv) {
     decomp = false;
   } else if (*s == 'd' || *s == 'D') {
     decomp = true;
+  } else if (*s == 'e') {
+    estimate = true;
+    nfiles = 1;
   } else {
     return usage();
   }
+  if (argc < 1 + nfiles)
+    return usage();
+
+  // Parse options
+  for (++argv, --argc; argc > nfiles; ++argv, --argc) {
+    if (!strcmp(argv[0], "-p") && argc > nfiles + 1) {
+      if (prime_load_for(&start, argv[1], ENG_BIACODE))
+        return 10;
+      primed = true;
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-a")) {
+      async = true;
+    } else if (!strcmp(argv[0], "-z")) {
+      async = zerocopy = true;
+    } else if (!strcmp(argv[0], "-D")) {
+      async = direct = true;
+    } else if (!strcmp(argv[0], "-b") && argc > nfiles + 1) {
+      blocksize = atoi(argv[1]);
+      if (blocksize < 1 || blocksize > (1 << 20)) {
+        cerr << "Block size must be 1 to 1048576 bytes" << endl;
+        return 10;
+      }
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-w") && argc > nfiles + 1) {
+      block = atol(argv[1]) << 10;
+      if (block < 4096 || block > (1L << 30)) {
+        cerr << "BWTS block must be 4 to 1048576 KB" << endl;
+        return 10;
+      }
+      async = true;
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-r")) {
+      async = rle = true;
+    } else if (!strcmp(argv[0], "-t") && argc > nfiles + 1) {
+      if (!shuffle_parse(argv[1], &shufspec)) {
+        cerr << "Bad shuffle \"" << argv[1] << "\", expected 2, 4 or 8 with optional d or x" << endl;
+        return 10;
+      }
+      shuf = &shufspec;
+      async = true;
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-j") && argc > nfiles + 1) {
+      threads = atoi(argv[1]);
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-s")) {
+      seekable = true;
+    } else if (!strcmp(argv[0], "-f") && argc > nfiles + 1) {
+      framesize = atol(argv[1]);
+      if (framesize < 1 || framesize > (1L << 30)) {
+        cerr << "Frame size must be 1 to 1073741824 bytes" << endl;
+        return 10;
+      }
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-i") && argc > nfiles + 1) {
+      sidename = argv[1];
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "--range") && argc > nfiles + 1) {
+      if (!seek_parse_range(argv[1], &off, &len)) {
+        cerr << "Bad range \"" << argv[1] << "\", expected offset:len" << endl;
+        return 10;
+      }
+      seekable = true;
+      ++argv;
+      --argc;
+    } else if (!strcmp(argv[0], "-S") && argc > nfiles + 1) {
+      percent = atoi(argv[1]);
+      if (percent < 1 || percent > 100) {
+        cerr << "Sample must be 1 to 100 percent" << endl;
+        return 10;
+      }
+      ++argv;
+      --argc;
+    } else if (budget_option(argv[0]) && argc > nfiles + 1) {
+      if (!budget_parse(argv[0], argv[1], &budget)) {
+        cerr << "Bad " << argv[0] << " \"" << argv[1] << "\", expected a number above 0" << endl;
+        return 10;
+      }
+      ++argv;
+      --argc;
+    } else {
+      return usage();
+    }
+  }
+
+  // -w and -t undo whole blocks, a block cut short would not give a prefix
+  if (budget.any() && (!decomp || seekable || rle || block || shuf)) {
+    cerr << "--max-out, --max-ratio and --max-time are for d, not with -s, -r, -w or -t" << endl;
+    return 10;
+  }
+
+  if (estimate) {
+    estimate_opts eo = {ENG_BIACODE, primed ? &start : NULL, shuf, block, percent};
+    FILE *in;
+    int r;
+
+    if (seekable || rle) {
+      cerr << "e does not go with -s or -r" << endl;
+      return 10;
+    }
+    if ((in = fopen(argv[0], "rb")) == NULL) {
+      cerr << "Could not read file \"" << argv[0] << endl;
+      return 10;
+    }
+    r = estimate_file(in, &eo, stdout);
+    fclose(in);
+    return r ? 10 : 0;
+  }
+
+  // Seekable container: frames are coded as messages by msgcodec.inc
+  if (seekable) {
+    static msg_codec codec;
+    FILE *in, *out, *side = NULL;
+    int r;
+
+    if (primed)
+      codec.prime(start);
+    codec.biablock = blocksize;
+    if ((in = fopen(argv[0], "rb")) == NULL) {
+      cerr << "Could not read file \"" << argv[0] << endl;
+      return 10;
+    }
+    if ((out = fopen(argv[1], "wb")) == NULL) {
+      cerr << "Could not write file \"" << argv[1] << endl;
+      return 10;
+    }
+    if (sidename && (side = fopen(sidename, decomp ? "rb" : "wb")) == NULL) {
+      cerr << "Could not open index file \"" << sidename << endl;
+      return 10;
+    }
+    if (decomp)
+      r = seek_decompress(codec, ENG_BIACODE, in, out, side, off, len);
+    else
+      r = seek_compress(codec, ENG_BIACODE, in, out, side, framesize);
+    if (side && fclose(side) != 0)
+      r = 2;
+    if (fclose(out) != 0)
+      r = 2;
+    fclose(in);
+    return r ? 10 : 0;
+  }
+
+  // Read ahead and write behind on their own threads (pipeline.inc), with
+  // -w the BWTS+MTF blocks (after the -t shuffle) are done by a pool on the
+  // input or output side
+  if (async) {
+    FILE *in, *out;
+    read_ahead ra;
+    write_behind wb;
+    long size = block ? block : 1L << 18;
+    int nbufs = (block ? threads : 2) + 2;
+    bool ok, badrun = false;
+
+    if ((in = fopen(argv[0], "rb")) == NULL) {
+      cerr << "Could not read file \"" << argv[0] << endl;
+      return 10;
+    }
+    if ((out = fopen(argv[1], "wb")) == NULL) {
+      cerr << "Could not write file \"" << argv[1] << endl;
+      return 10;
+    }
+    if (threads < 1)
+      threads = 1;
+    if (block && decomp)
+      wb.transform(bwts_mtf_decode, NULL, threads);
+    if (shuf && decomp)
+      wb.transform(shuffle_decode, shuf, threads);
+    if (shuf && !decomp)
+      ra.transform(shuffle_encode, shuf, threads);
+    if (block && !decomp)
+      ra.transform(bwts_mtf_encode, NULL, threads);
+    ra.start(fileno(in), decomp ? 4 : nbufs, decomp ? 1L << 18 : size);
+    wb.start(fileno(out), decomp ? nbufs : 4, decomp ? size : 1L << 18,
+             (zerocopy ? PIPE_ZEROCOPY : 0) | (direct ? PIPE_DIRECT : 0));
+    if (direct && !wb.direct)
+      cerr << "O_DIRECT not available for \"" << argv[1] << "\", writing through the page cache" << endl;
+    {
+      // -r puts the run-length stage between the pipes and the coder
+      rle_reader rr(&ra);
+      rle_writer *rw = rle && decomp ? new rle_writer(&wb) : NULL;
+      PipeInBuf ib(ra), rib(rr);
+      PipeOutBuf *ob = rw ? NULL : new PipeOutBuf(wb);
+      RleOutBuf *rob = rw ? new RleOutBuf(*rw) : NULL;
+      istream instr(rle && !decomp ? &rib : &ib);
+      ostream outstr(rw ? (streambuf *)rob : (streambuf *)ob);
+      SimpleAdaptiveModel model(256);
+
+      if (primed)
+        model.Prime(start.syms, start.nsyms);
+      if (budget.any())
+        budget.start(in);
+      Code(instr, outstr, model, decomp, blocksize, budget.any() ? &budget : NULL);
+      if (rw) {
+        rob->End();
+        if (rw->bad)
+          cerr << "Run longer than " << rle_max_run << " bytes" << endl;
+        badrun = rw->bad;
+      } else {
+        ob->End();
+      }
+      delete ob;
+      delete rob;
+      delete rw;
+    }
+    ra.stop();
+    ok = wb.finish() && !ra.failed && !badrun;
+    fclose(in);
+    if (fclose(out) != 0 || !ok) {
+      cerr << "I/O error" << endl;
+      return 10;
+    }
+    return BudgetReport(budget);
+  }
 
   // Open input and output files
   {
-    ifstream infile(argv[1], ios::in | ios::binary);
+    ifstream infile(argv[0], ios::in | ios::binary);
     if (infile.fail()) {
-      cerr << "Could not read file \"" << argv[1] << endl;
+      cerr << "Could not read file \"" << argv[0] << endl;
       return 10;
     }
 
-    ofstream outfile(argv[2], ios::out | ios::binary);
+    ofstream outfile(argv[1], ios::out | ios::binary);
     if (outfile.fail()) {
-      cerr << "Could not write file \"" << argv[2] << endl;
+      cerr << "Could not write file \"" << argv[1] << endl;
       return 10;
     }
 
     // Initialize adaptive model for 256 symbols (bytes)
     SimpleAdaptiveModel model(256);
-    int sym;
-
-    if (decomp) {
-      // DECOMPRESSION MODE
-      // Algorithm: Bijective arithmetic decoding
-      // - Reads a finitely-odd bit stream (stream ending with final 1, then infinite 0s)
-      // - Uses arithmetic decoder to map bit stream back to symbol probabilities
-      // - Adaptive model updates probabilities after each symbol
-      // - Decoding stops when special end-of-stream marker is encountered
-
-      FOBitIStream inbits(infile, blocksize);
-      ArithmeticDecoder decoder(inbits);
-
-      for (;;) {
-        // Decode next symbol using current probability model
-        // The 'true' parameter indicates this could be end-of-stream
-        sym = decoder.Decode(&model, true);
-        if (sym < 0)
-          break; // End of stream
-
-        outfile.put((char)(sym));
-
-        // Update model with decoded symbol for adaptive compression
-        model.Update(sym);
-      }
-    } else {
-      // COMPRESSION MODE
-      // Algorithm: Bijective arithmetic encoding
-      // - Maps input byte stream to a finitely-odd bit stream
-      // - Uses arithmetic encoder to narrow probability intervals
-      // - Each symbol narrows the interval based on its probability
-      // - Adaptive model updates probabilities to match input statistics
-      // - Bijection ensures unique reversible encoding (no ambiguity)
-
-      FOBitOStream outbits(outfile, blocksize);
-      ArithmeticEncoder encoder(outbits);
-
-      for (;;) {
-        sym = infile.get();
-        if (sym < 0)
-          break; // End of input
-
-        // Encode symbol into the probability interval
-        // The 'true' parameter reserves a "free end" for potential stream termination
-        encoder.Encode(&model, sym, true);
 
-        // Update model with encoded symbol for adaptive compression
-        model.Update(sym);
-      }
+    if (primed)
+      model.Prime(start.syms, start.nsyms);
 
-      // Finalize encoding by writing the "free end" terminator
-      encoder.End();
-      outbits.End();
+    // The input size is for --max-ratio, not known for a pipe
+    if (budget.any()) {
+      struct stat st;
+      budget.start(stat(argv[0], &st) == 0 && S_ISREG(st.st_mode) ? (long long)st.st_size : 0);
     }
 
+    Code(infile, outfile, model, decomp, blocksize, budget.any() ? &budget : NULL);
+
     outfile.close();
     infile.close();
   }
 
-  return 0;
+  return BudgetReport(budget);
 }
 
 /**
@@ -0,0 +1,185 @@
+/**
+ * bijcheck - Exhaustive check that the coders are bijections
+ *
+ * A bijective coder maps every byte string to a different byte string and
+ * every byte string is the coding of one. For every engine and every
+ * string x of 0 to N bytes this checks both directions: decode(encode(x))
+ * and encode(decode(x)) must give back x. Each engine codes messages the
+ * way the tools and msgcodec.inc do, from a fresh model.
+ *
+ * The strings of one length are split by their first bytes into tasks for
+ * a work stealing pool (workpool.inc); each worker has its own coders. The
+ * cases and time per engine and length are printed, and on the first
+ * mismatch the string as hex, with exit code 1. arb_coder's sanity checks
+ * end the process with exit code 0, so only the closing line "All strings
+ * code both ways" means the check passed.
+ *
+ * USAGE: bijcheck [-e engine] [-j threads] <max bytes>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "arbnib.inc"
+#include "msgcodec.inc"
+#include "workpool.inc"
+
+enum { BIJ_ARB255, BIJ_NIB, BIJ_BIACODE, BIJ_COUNT };
+
+static const char *bij_name[BIJ_COUNT] = {"arb255", "arb255n", "biacode"};
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nExhaustive bijectivity check of the coders\n");
+  fprintf(stderr, "USAGE: %s [-e engine] [-j threads] <max bytes>\n\n", progname);
+  fprintf(stderr, "  -e engine   arb255, arb255n (nibble coder, -n) or biacode (default: all)\n");
+  fprintf(stderr, "  -j threads  worker threads (default: all cores)\n\n");
+  fprintf(stderr, "Every string of 0 to max bytes is coded both ways; 3 bytes are 16M strings.\n\n");
+}
+
+// A worker's coders and buffers
+struct bij_worker {
+  arb_coder arb;
+  arb_nib_coder nib;
+  SimpleAdaptiveModel bia;
+  std::vector<BYTE> mid, back;
+
+  bij_worker() : bia(256), mid(64), back(64) {}
+
+  /**
+   * Code n bytes at src one way with engine e into out, growing it as
+   * needed; returns the size
+   */
+  long code(int e, int decomp, const BYTE *src, long n, std::vector<BYTE> &out) {
+    long r;
+
+    for (;;) {
+      if (e == BIJ_ARB255) {
+        msg_reset(&arb, NULL);
+        r = decomp ? arb_msg_decode(&arb, src, n, &out[0], (long)out.size())
+                   : arb_msg_encode(&arb, src, n, &out[0], (long)out.size());
+      } else if (e == BIJ_NIB) {
+        nib.reset();
+        r = decomp ? nib_msg_decode(&nib, src, n, &out[0], (long)out.size())
+                   : nib_msg_encode(&nib, src, n, &out[0], (long)out.size());
+      } else {
+        bia.Reset();
+        r = decomp ? bia_msg_decode(&bia, src, n, &out[0], (long)out.size())
+                   : bia_msg_encode(&bia, src, n, &out[0], (long)out.size());
+      }
+      if (r <= (long)out.size())
+        return r;
+      out.resize(r);
+    }
+  }
+
+  /**
+   * x through one way and back; returns 0 or the way that failed,
+   * 1 for decode(encode(x)) and 2 for encode(decode(x))
+   */
+  int check(int e, const BYTE *x, long n) {
+    for (int way = 0; way < 2; ++way) {
+      long m = code(e, way, x, n, mid);
+      if (code(e, 1 - way, &mid[0], m, back) != n || memcmp(&back[0], x, n) != 0)
+        return way + 1;
+    }
+    return 0;
+  }
+
+private:
+  bij_worker(const bij_worker &);
+  void operator=(const bij_worker &);
+};
+
+/**
+ * Check every string of len bytes with engine e; returns false after
+ * printing the first one that fails
+ */
+static bool check_length(int e, int len, work_pool &pool, std::vector<bij_worker *> &workers) {
+  int k = len < 3 ? len : 2; // Bytes fixed by the task number
+  long ntasks = 1L << (8 * k), nsuffix = 1L << (8 * (len - k));
+  std::vector<long> order(ntasks);
+  std::atomic<bool> failed(false);
+  std::mutex lock;
+  BYTE bad[8];
+  int badway = 0;
+
+  for (long t = 0; t < ntasks; ++t)
+    order[t] = t;
+  pool.run(order, [&](long t, int w) {
+    BYTE x[8];
+
+    for (int i = 0; i < k; ++i)
+      x[i] = (BYTE)(t >> (8 * i));
+    for (long s = 0; s < nsuffix && !failed; ++s) {
+      int way;
+
+      for (int i = k; i < len; ++i)
+        x[i] = (BYTE)(s >> (8 * (i - k)));
+      if ((way = workers[w]->check(e, x, len)) != 0) {
+        std::lock_guard<std::mutex> g(lock);
+        if (!failed) {
+          memcpy(bad, x, len);
+          badway = way;
+          failed = true;
+        }
+      }
+    }
+  });
+
+  if (failed) {
+    printf("%s: %s is not the identity for", bij_name[e], badway == 1 ? "decode(encode(x))" : "encode(decode(x))");
+    for (int i = 0; i < len; ++i)
+      printf(" %02x", bad[i]);
+    printf("%s\n", len ? "" : " the empty string");
+  }
+  return !failed;
+}
+
+int main(int argc, char *argv[]) {
+  int a, e0 = 0, e1 = BIJ_COUNT, maxlen, nthreads = 0;
+  std::vector<bij_worker *> workers;
+
+  for (a = 1; a < argc - 1 && argv[a][0] == '-'; a += 2) {
+    if (strcmp(argv[a], "-e") == 0) {
+      for (e0 = BIJ_COUNT - 1; e0 >= 0 && strcmp(argv[a + 1], bij_name[e0]); --e0)
+        ;
+      if (e0 < 0) {
+        fprintf(stderr, "Unknown engine: %s\n", argv[a + 1]);
+        return 1;
+      }
+      e1 = e0 + 1;
+    } else if (strcmp(argv[a], "-j") == 0) {
+      nthreads = atoi(argv[a + 1]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (a != argc - 1 || (maxlen = atoi(argv[a])) < 0 || maxlen > 4) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  work_pool pool(nthreads);
+  for (int w = 0; w < pool.nthreads; ++w)
+    workers.push_back(new bij_worker);
+
+  printf("%-8s %5s %12s %10s  (%d threads)\n", "engine", "bytes", "strings", "seconds", pool.nthreads);
+  for (int e = e0; e < e1; ++e) {
+    for (int len = 0; len <= maxlen; ++len) {
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+      if (!check_length(e, len, pool, workers))
+        return 1;
+      printf("%-8s %5d %12lld %10.2f\n", bij_name[e], len, 1LL << (8 * len),
+             std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+      fflush(stdout);
+    }
+  }
+  printf("All strings code both ways\n");
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * iocheck - Whole file reads and writes of batch_io (batchio.inc)
+ *
+ * Reads each file with batch_io::read_files on the given backend and
+ * compares the bytes with a plain read() of it, then writes them to
+ * <file>.io with write_files and compares that file the same way. Meant
+ * for what arbar's small test files do not reach: files over io_max
+ * bytes, which no single read or write moves. Exit code 1 on mismatch.
+ *
+ * USAGE: iocheck [-I io] <file>...
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "batchio.inc"
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nWhole file reads and writes of batch_io against plain read()\n");
+  fprintf(stderr, "USAGE: %s [-I io] <file>...\n\n", progname);
+  fprintf(stderr, "  -I io  auto, io_uring or sync (default auto)\n\n");
+}
+
+/**
+ * Compare n bytes at p with the file name, read with plain read() in
+ * pieces; returns the size of the file, or -1 if it differs
+ */
+static long long same_as_file(const unsigned char *p, long long n, const char *name) {
+  std::vector<unsigned char> buf(1 << 20);
+  long long pos = 0;
+  ssize_t k;
+  int fd;
+
+  if ((fd = open(name, O_RDONLY)) < 0)
+    return -1;
+  while ((k = read(fd, &buf[0], buf.size())) > 0) {
+    if (pos + k > n || memcmp(p + pos, &buf[0], k) != 0) {
+      close(fd);
+      return -1;
+    }
+    pos += k;
+  }
+  close(fd);
+  return k < 0 ? -1 : pos;
+}
+
+int main(int argc, char *argv[]) {
+  int a, want = IO_AUTO, fail = 0;
+  batch_io io;
+
+  for (a = 1; a < argc && argv[a][0] == '-'; a += 2) {
+    if (strcmp(argv[a], "-I") == 0 && a + 1 < argc) {
+      for (want = 2; want >= 0 && strcmp(argv[a + 1], io_name[want]); --want)
+        ;
+      if (want < 0) {
+        fprintf(stderr, "Unknown I/O backend: %s\n", argv[a + 1]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (a == argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (io.open(want) < 0) {
+    fprintf(stderr, "io_uring is not available\n");
+    return 1;
+  }
+
+  for (; a < argc; ++a) {
+    std::string out = std::string(argv[a]) + ".io";
+    std::vector<unsigned char> buf;
+    struct stat st;
+    io_req q;
+
+    if (stat(argv[a], &st) != 0) {
+      fprintf(stderr, "Could not read: %s\n", argv[a]);
+      fail = 1;
+      continue;
+    }
+    // One byte more than the stat size, as arbar reads
+    buf.resize((size_t)st.st_size + 1);
+    memset(&q, 0, sizeof(q));
+    q.name = argv[a];
+    q.p = &buf[0];
+    q.len = (long)st.st_size + 1;
+    io.read_files(&q, 1);
+    bool rd = q.res == (long long)st.st_size && same_as_file(&buf[0], q.res, argv[a]) == q.res;
+
+    q.name = out.c_str();
+    q.len = (long)st.st_size;
+    io.write_files(&q, 1);
+    bool wr = q.res == (long long)st.st_size && same_as_file(&buf[0], q.res, out.c_str()) == q.res;
+    unlink(out.c_str());
+
+    printf("%s: %lld bytes, %s read %s, write %s\n", argv[a], (long long)st.st_size, io_name[io.kind],
+           rd ? "same" : "DIFFERS", wr ? "same" : "DIFFERS");
+    if (!rd || !wr)
+      fail = 1;
+  }
+  return fail;
+}
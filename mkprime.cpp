@@ -0,0 +1,67 @@
+/**
+ * mkprime - Train a model snapshot on sample data
+ *
+ * Runs the arb255 or biacode model over the sample files and writes the
+ * resulting starting state (see prime.inc) for "arb255 -p", "biacode -p"
+ * and msg_codec::prime. Use samples that look like the data to be coded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prime.inc"
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nModel snapshot trainer\n");
+  fprintf(stderr, "USAGE: %s arb255|biacode [-l limit] <model> <sample>...\n\n", progname);
+  fprintf(stderr, "  -l:  arb255 only, largest Ftot kept per context (default 1024)\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  static model_prime mp;
+  static BYTE buf[65536];
+  unsigned limit = 1024;
+  long total = 0;
+  size_t n;
+  int a, eng;
+
+  if (argc < 4 || (eng = eng_find(argv[1])) < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (a = 2; a < argc && argv[a][0] == '-'; ++a) {
+    if (strcmp(argv[a], "-l") == 0 && a + 1 < argc) {
+      limit = (unsigned)atol(argv[++a]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - a < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  mp.clear(eng);
+  for (int i = a + 1; i < argc; ++i) {
+    FILE *f = fopen(argv[i], "rb");
+    if (f == NULL) {
+      fprintf(stderr, "Could not open sample file: %s\n", argv[i]);
+      return 1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      mp.train(buf, (long)n);
+      total += (long)n;
+    }
+    fclose(f);
+  }
+  mp.finish(limit);
+
+  if (mp.save(argv[a])) {
+    fprintf(stderr, "Could not write model file: %s\n", argv[a]);
+    return 2;
+  }
+  fprintf(stderr, "%s model trained on %ld bytes written to %s\n", eng_name[eng], total, argv[a]);
+  return 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * msgbench - latency of the small message API (msgcodec.inc)
+ *
+ * For record-like messages of 64 bytes to 4 KB, codes each message with a
+ * pooled coder/model and with a freshly constructed one, and prints p50/p99
+ * latency of encode and decode plus heap allocations per pooled message.
+ * Every message is checked to round trip; the exit code is 1 on mismatch.
+ *
+ * USAGE: msgbench [-p model]... [-s streams] [messages per size]
+ *        msgbench -w <file>   (write 64 KB of sample records for mkprime)
+ *
+ * -p starts messages from a snapshot made by mkprime (one per engine).
+ * -s also codes 4 messages on each of that many long lived streams that
+ *    share one base model, and reports the memory each stream holds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <vector>
+#include "msgcodec.inc"
+#include "records.inc"
+
+static long heap_allocs = 0;
+
+void *operator new(size_t n) {
+  void *p;
+  ++heap_allocs;
+  if ((p = malloc(n ? n : 1)) == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double usec_since(bench_clock::time_point t0) {
+  return std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count();
+}
+
+static double pct(std::vector<double> &v, double p) {
+  size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+/**
+ * Code rounds of 256 byte messages on nstreams streams per side sharing one
+ * base model, then check a single long stream against a private model.
+ * Returns nonzero on mismatch.
+ */
+static int bench_streams(msg_codec &codec, model_prime *pr[ENG_COUNT], long nstreams, unsigned *seed) {
+  const long n = 256, rounds = 4, longmsgs = 40;
+  std::vector<BYTE> msg(n), enc(2 * n), dec(2 * n), ref(2 * n);
+  int fail = 0;
+
+  printf("\n%-8s %8s %12s %12s %12s\n", "engine", "streams", "bytes/stream", "private", "msgs/s");
+
+  for (int eng = 0; eng < ENG_COUNT; ++eng) {
+    model_base base(eng, pr[eng]);
+    std::vector<model_stream *> es, ds;
+    long mem = 0, priv;
+
+    for (long i = 0; i < nstreams; ++i) {
+      es.push_back(new model_stream(base));
+      ds.push_back(new model_stream(base));
+    }
+
+    bench_clock::time_point t0 = bench_clock::now();
+    for (long r = 0; r < rounds; ++r) {
+      for (long i = 0; i < nstreams; ++i) {
+        make_record(&msg[0], n, seed);
+        long clen = codec.code(es[i], 0, &msg[0], n, &enc[0], (long)enc.size());
+        long dlen = codec.code(ds[i], 1, &enc[0], clen, &dec[0], (long)dec.size());
+        if (clen > (long)enc.size() || dlen != n || !std::equal(msg.begin(), msg.end(), dec.begin()))
+          fail = 1;
+      }
+    }
+    double secs = usec_since(t0) / 1e6;
+
+    for (long i = 0; i < nstreams; ++i) {
+      mem += es[i]->bytes();
+      delete es[i];
+      delete ds[i];
+    }
+    priv = (eng == ENG_ARB255) ? (long)sizeof(bij_2c) * 255 : (long)sizeof(SimpleAdaptiveModel) + 512 * (long)sizeof(U32);
+    printf("%-8s %8ld %12ld %12ld %12.0f\n", eng_name[eng], nstreams, nstreams ? mem / nstreams : 0, priv,
+           secs > 0 ? 2.0 * rounds * nstreams / secs : 0.0);
+
+    // A stream past the 4096 symbol window must code like a private model
+    model_stream st(base);
+    arb_coder rc;
+    bij_2c keep[255];
+    SimpleAdaptiveModel rm(256);
+
+    for (int i = 0; i < 255; ++i)
+      keep[i] = base.ff[i];
+    if (base.bia)
+      rm.Assign(*base.bia);
+
+    for (long m = 0; m < longmsgs; ++m) {
+      long clen, rlen;
+
+      make_record(&msg[0], n, seed);
+      clen = codec.code(&st, 0, &msg[0], n, &enc[0], (long)enc.size());
+      if (eng == ENG_ARB255) {
+        rc.prime = keep;
+        rc.reset();
+        rlen = arb_msg_encode(&rc, &msg[0], n, &ref[0], (long)ref.size());
+        for (int i = 0; i < 255; ++i)
+          keep[i] = rc.ff[i];
+      } else {
+        rlen = bia_msg_encode(&rm, &msg[0], n, &ref[0], (long)ref.size());
+      }
+      if (clen != rlen || !std::equal(enc.begin(), enc.begin() + clen, ref.begin())) {
+        fprintf(stderr, "%s: stream model differs from a private model at message %ld\n", eng_name[eng], m);
+        fail = 1;
+        break;
+      }
+    }
+  }
+
+  if (fail)
+    fprintf(stderr, "stream round trip failed\n");
+  return fail;
+}
+
+int main(int argc, char *argv[]) {
+  static const long sizes[] = {64, 128, 256, 512, 1024, 2048, 4096};
+  static model_prime mp[ENG_COUNT];
+  model_prime *pr[ENG_COUNT] = {NULL, NULL};
+  long count = 2000, nstreams = 0;
+  std::vector<BYTE> msgs, enc(8192), dec(8192);
+  std::vector<double> te, td, tc;
+  msg_codec codec;
+  unsigned seed = 1;
+  int a, fail = 0;
+
+  for (a = 1; a < argc - 1 && argv[a][0] == '-'; a += 2) {
+    if (strcmp(argv[a], "-p") == 0) {
+      model_prime p;
+      if (p.load(argv[a + 1])) {
+        fprintf(stderr, "Could not load model file: %s\n", argv[a + 1]);
+        return 2;
+      }
+      mp[p.eng] = p;
+      pr[p.eng] = &mp[p.eng];
+      codec.prime(p);
+    } else if (strcmp(argv[a], "-s") == 0) {
+      nstreams = atol(argv[a + 1]);
+    } else if (strcmp(argv[a], "-w") == 0) {
+      // Different seed than the benchmark so the model isn't trained on the test data
+      FILE *f = fopen(argv[a + 1], "wb");
+      seed = 99;
+      msgs.resize(65536);
+      make_record(&msgs[0], (long)msgs.size(), &seed);
+      if (f == NULL || fwrite(&msgs[0], 1, msgs.size(), f) != msgs.size() || fclose(f) != 0) {
+        fprintf(stderr, "Could not write sample file: %s\n", argv[a + 1]);
+        return 2;
+      }
+      return 0;
+    } else {
+      break;
+    }
+  }
+  if (a < argc)
+    count = atol(argv[a]);
+  if (count < 1)
+    count = 1;
+
+  codec.warm(1);
+  te.reserve(count);
+  td.reserve(count);
+  tc.reserve(count);
+
+  printf("%-8s %6s %10s %10s %10s %10s %10s %10s %8s %7s\n", "engine", "bytes", "enc p50", "enc p99", "dec p50", "dec p99",
+         "cold p50", "cold p99", "ratio", "allocs");
+
+  for (int eng = 0; eng < ENG_COUNT; ++eng) {
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      long n = sizes[s], clen = 0, total = 0, allocs;
+
+      te.clear();
+      td.clear();
+      tc.clear();
+      msgs.resize(n * count);
+      make_record(&msgs[0], n * count, &seed);
+      allocs = heap_allocs;
+
+      for (long i = 0; i < count; ++i) {
+        BYTE *msg = &msgs[n * i];
+        bench_clock::time_point t0 = bench_clock::now();
+        clen = codec.encode(eng, msg, n, &enc[0], (long)enc.size());
+        te.push_back(usec_since(t0));
+
+        t0 = bench_clock::now();
+        long dlen = codec.decode(eng, &enc[0], clen, &dec[0], (long)dec.size());
+        td.push_back(usec_since(t0));
+
+        if (clen > (long)enc.size() || dlen != n || !std::equal(msg, msg + n, dec.begin())) {
+          fprintf(stderr, "%s: round trip failed for %ld byte message\n", eng_name[eng], n);
+          fail = 1;
+        }
+        total += clen;
+      }
+      allocs = heap_allocs - allocs;
+
+      // Cold path: construct the coder/model for every message as the tools do
+      for (long i = 0; i < count; ++i) {
+        BYTE *msg = &msgs[n * i];
+        bench_clock::time_point t0 = bench_clock::now();
+        if (eng == ENG_ARB255) {
+          arb_coder *c = new arb_coder;
+          msg_reset(c, codec.arb.base);
+          arb_msg_encode(c, msg, n, &enc[0], (long)enc.size());
+          delete c;
+        } else {
+          SimpleAdaptiveModel *m = new SimpleAdaptiveModel(256);
+          msg_reset(m, codec.bia.base);
+          bia_msg_encode(m, msg, n, &enc[0], (long)enc.size());
+          delete m;
+        }
+        tc.push_back(usec_since(t0));
+      }
+
+      printf("%-8s %6ld %8.2fus %8.2fus %8.2fus %8.2fus %8.2fus %8.2fus %8.3f %7.2f\n", eng_name[eng], n, pct(te, 0.5),
+             pct(te, 0.99), pct(td, 0.5), pct(td, 0.99), pct(tc, 0.5), pct(tc, 0.99), (double)total / ((double)n * count),
+             (double)allocs / (2.0 * count));
+    }
+  }
+
+  if (nstreams > 0)
+    fail |= bench_streams(codec, pr, nstreams, &seed);
+
+  return fail;
+}
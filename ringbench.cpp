@@ -0,0 +1,181 @@
+/**
+ * ringbench - Throughput of the shared memory ring transport (shmring.inc)
+ *
+ * Forks one compressor process and some producer processes sharing one
+ * channel. Every producer writes records straight into the request ring,
+ * has them compressed, then sends the results back for decompression and
+ * checks them against the original. Prints messages per second and the
+ * compressor's coding throughput per core. Exit code 1 on mismatch.
+ *
+ * USAGE: ringbench [-e engine] [-P producers] [-m bytes] [-r ring KB] [messages per producer]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <vector>
+#include "records.inc"
+#include "shmring.inc"
+
+struct bench_result {
+  long done;   // Requests coded
+  double busy; // ns spent coding
+};
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nShared memory ring transport benchmark\n");
+  fprintf(stderr, "USAGE: %s [-e engine] [-P producers] [-m bytes] [-r ring KB] [messages per producer]\n\n", progname);
+  fprintf(stderr, "  -e engine    arb255 or biacode (default arb255)\n");
+  fprintf(stderr, "  -P producers producer processes (default 2, at most 255)\n");
+  fprintf(stderr, "  -m bytes     message size (default 256)\n");
+  fprintf(stderr, "  -r ring KB   size of each ring (default 256, a power of 2)\n\n");
+}
+
+// Seed of message i of a producer, so the original can be rebuilt to check
+static unsigned msg_seed(int from, long i) { return (unsigned)(from * 1000003 + i + 1); }
+
+/**
+ * Compress then decompress n messages; returns nonzero on mismatch
+ */
+int produce(shm_channel *ch, int from, int eng, long n, unsigned len) {
+  const long window = 64;
+  shm_ring *rq = ch->requests(), *rs = ch->responses(from);
+  std::vector<std::vector<BYTE> > coded(n);
+  std::vector<BYTE> orig(len);
+  unsigned spins = 0, seed;
+  int fail = 0;
+
+  for (int pass = 0; pass < 2; ++pass) {
+    long sent = 0, got = 0;
+
+    while (got < n) {
+      ring_rec *q, *r;
+      ring_pos start, end;
+      bool idle = true;
+
+      while ((r = rs->peek()) != NULL) {
+        if (r->op != 0 || r->tag >= (ring_pos)n) {
+          fail = 1;
+        } else if (pass == 0) {
+          coded[r->tag].assign(r->data(), r->data() + r->len);
+        } else {
+          seed = msg_seed(from, (long)r->tag);
+          make_record(&orig[0], len, &seed);
+          if (r->len != len || memcmp(r->data(), &orig[0], len) != 0)
+            fail = 1;
+        }
+        rs->release(r);
+        ++got;
+        idle = false;
+      }
+
+      unsigned qlen = pass ? (unsigned)coded[sent < n ? sent : 0].size() : len;
+      if (sent < n && sent - got < window && (q = rq->claim(qlen, &start, &end)) != NULL) {
+        if (pass == 0) {
+          seed = msg_seed(from, sent);
+          make_record(q->data(), len, &seed);
+        } else if (qlen) {
+          memcpy(q->data(), &coded[sent][0], qlen);
+        }
+        q->op = pass ? 'd' : 'c';
+        q->eng = (BYTE)eng;
+        q->from = (BYTE)from;
+        q->tag = sent++;
+        rq->publish_claimed(start, end);
+        idle = false;
+      }
+
+      if (idle)
+        ring_wait(&spins);
+      else
+        spins = 0;
+    }
+  }
+  return fail;
+}
+
+int main(int argc, char *argv[]) {
+  long n = 2000, ringkb = 256;
+  unsigned len = 256;
+  int a, eng = ENG_ARB255, nprod = 2, fail = 0, status;
+
+  for (a = 1; a < argc - 1 && argv[a][0] == '-'; a += 2) {
+    if (strcmp(argv[a], "-e") == 0 && (eng = eng_find(argv[a + 1])) >= 0) {
+      continue;
+    } else if (strcmp(argv[a], "-P") == 0) {
+      nprod = atoi(argv[a + 1]);
+    } else if (strcmp(argv[a], "-m") == 0) {
+      len = (unsigned)atol(argv[a + 1]);
+    } else if (strcmp(argv[a], "-r") == 0) {
+      ringkb = atol(argv[a + 1]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (a < argc)
+    n = atol(argv[a]);
+  if (eng < 0 || nprod < 1 || nprod > 255 || n < 1 || ringkb < 4 || (ringkb & (ringkb - 1))) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  ring_pos cap = (ring_pos)ringkb << 10;
+  size_t bytes = shm_channel::bytes(nprod, cap);
+  shm_channel *ch = (shm_channel *)shm_map(NULL, bytes, true);
+  bench_result *res = (bench_result *)shm_map(NULL, sizeof(bench_result), true);
+
+  if (ch == NULL || res == NULL) {
+    fprintf(stderr, "Could not map %lu bytes of shared memory\n", (unsigned long)bytes);
+    return 2;
+  }
+  ch->init(nprod, cap);
+  if (len + len / 4 + 64 > ch->requests()->max_len()) {
+    fprintf(stderr, "Messages of %u bytes need a bigger ring (-r)\n", len);
+    return 1;
+  }
+
+  pid_t worker = fork();
+  if (worker == 0) {
+    msg_codec codec;
+    codec.warm(1);
+    res->done = shm_serve(codec, ch, &res->busy);
+    _exit(0);
+  }
+
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  std::vector<pid_t> prod;
+  for (int i = 0; i < nprod; ++i) {
+    pid_t p = fork();
+    if (p == 0)
+      _exit(produce(ch, i, eng, n, len));
+    prod.push_back(p);
+  }
+  for (size_t i = 0; i < prod.size(); ++i)
+    if (waitpid(prod[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+      fail = 1;
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  ring_rec *q;
+  ring_pos start, end;
+  unsigned spins = 0;
+  while ((q = ch->requests()->claim(0, &start, &end)) == NULL)
+    ring_wait(&spins);
+  q->op = 'q';
+  ch->requests()->publish_claimed(start, end);
+  waitpid(worker, &status, 0);
+
+  double raw = 2.0 * nprod * n * len; // Compressed from and decompressed to
+  printf("%s, %d producers, %u byte messages, %ld KB rings\n", eng_name[eng], nprod, len, ringkb);
+  printf("requests    %ld\n", res->done);
+  printf("wall        %.3f s, %.0f requests/s\n", secs, res->done / secs);
+  printf("per core    %.2f MB/s coded, %.2f us per request\n", res->busy > 0 ? raw * 1e3 / res->busy : 0.0,
+         res->done ? res->busy / 1e3 / res->done : 0.0);
+  printf("transport   %.2f us per request outside coding\n",
+         res->done ? (secs * 1e9 - res->busy) / 1e3 / res->done : 0.0);
+  if (fail || res->done != 2 * nprod * n)
+    fprintf(stderr, "ring round trip failed\n");
+  return fail || res->done != 2 * nprod * n;
+}
@@ -0,0 +1,380 @@
+/**
+ * slowfuzz - Search for inputs that make the coders slow or expand
+ *
+ * The time a coder spends per byte depends on the input: long runs of
+ * bits_to_follow, searches for a free end that miss (the loops of inc_fre,
+ * FRX with the high free ends, biacode's nextfreeend loop) and, when
+ * decoding arbitrary bytes, how much output comes out of little input. This
+ * is a small local fuzzer that looks for the worst of those, for every
+ * engine and both directions (c encodes the input, d decodes it):
+ *
+ *   - the cost of a run is cycles (rdtsc) per input byte, the least of
+ *     three runs whenever a run looks like a new worst case; inputs under
+ *     fuzz_min bytes count as fuzz_min, or the fixed cost of starting a
+ *     message would make every 1 byte input the worst;
+ *   - an input joins the corpus when it covers something new: a new
+ *     combination of log2 buckets of its length, its expansion and its
+ *     cost, and for arb255 whether the high free ends were used (FRXX);
+ *   - parents are taken half from the current worst cases, half from the
+ *     corpus, and mutated by bit flips, byte changes, inserts, deletes,
+ *     runs of 00/ff, copies within the input and splices of two inputs.
+ *
+ * Every input is also checked to code back to itself. At the end the worst
+ * cycles per byte and the worst expansion are printed per engine and
+ * direction, next to the cost of random inputs of the largest size.
+ *
+ * With -c the worst inputs of every engine and direction, 8 by cost and 8
+ * by expansion, are kept in a directory as a regression corpus
+ * (<engine>.<c|d>.<n>), and the files there are the seeds of the next
+ * run; -r only replays them and reports. Cycles are time stamp counter
+ * ticks; without one (not x86) the same columns are nanoseconds.
+ *
+ * USAGE: slowfuzz [-e engine] [-n max bytes] [-i iterations] [-s seed] [-c dir] [-r]
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "arbnib.inc"
+#include "msgcodec.inc"
+
+enum { FUZZ_ARB255, FUZZ_NIB, FUZZ_BIACODE, FUZZ_COUNT };
+
+static const char *fuzz_name[FUZZ_COUNT] = {"arb255", "arb255n", "biacode"};
+static const int fuzz_keep = 8;   // Worst inputs kept per engine and direction
+static const long fuzz_min = 32; // Shorter inputs are charged as this many bytes
+
+void usage(const char *progname) {
+  fprintf(stderr, "\nSearch for slow and expanding inputs of the coders\n");
+  fprintf(stderr, "USAGE: %s [-e engine] [-n max bytes] [-i iterations] [-s seed] [-c dir] [-r]\n\n", progname);
+  fprintf(stderr, "  -e engine      arb255, arb255n or biacode (default: all)\n");
+  fprintf(stderr, "  -n max bytes   largest input tried (default 1024)\n");
+  fprintf(stderr, "  -i iterations  mutated inputs per engine and direction (default 20000)\n");
+  fprintf(stderr, "  -s seed        random seed (default 1)\n");
+  fprintf(stderr, "  -c dir         regression corpus: seeds from and worst inputs to dir\n");
+  fprintf(stderr, "  -r             only replay the corpus of -c and report\n\n");
+}
+
+// Time stamp in cycles where the CPU has a counter, else in nanoseconds
+static inline unsigned long long fuzz_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+static unsigned fuzz_rand(unsigned *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static int log2_bucket(double x) {
+  int b = 0;
+
+  for (; x >= 2 && b < 40; x /= 2)
+    ++b;
+  return b;
+}
+
+// One input and what it cost
+struct fuzz_case {
+  std::vector<BYTE> in;
+  double cost;   // Ticks per input byte
+  double expand; // Output bytes per input byte
+};
+
+// The coders of one engine and direction, and what the last run did
+struct fuzz_target {
+  int eng, decomp;
+  arb_coder arb;
+  arb_nib_coder nib;
+  SimpleAdaptiveModel bia;
+  std::vector<BYTE> out, back;
+  long outlen;
+  int frxx; // arb255 used the high free ends
+
+  fuzz_target(int e, int d) : eng(e), decomp(d), bia(256), out(4096), back(4096), outlen(0), frxx(0) {}
+
+  // Code n bytes at src one way into o, growing it as needed; returns the size
+  long code(int way, const BYTE *src, long n, std::vector<BYTE> &o) {
+    long r;
+
+    for (;;) {
+      if (eng == FUZZ_ARB255) {
+        msg_reset(&arb, NULL);
+        r = way ? arb_msg_decode(&arb, src, n, &o[0], (long)o.size()) : arb_msg_encode(&arb, src, n, &o[0], (long)o.size());
+        frxx = arb.FRXX;
+      } else if (eng == FUZZ_NIB) {
+        nib.reset();
+        r = way ? nib_msg_decode(&nib, src, n, &o[0], (long)o.size()) : nib_msg_encode(&nib, src, n, &o[0], (long)o.size());
+        frxx = nib.FRXX;
+      } else {
+        bia.Reset();
+        r = way ? bia_msg_decode(&bia, src, n, &o[0], (long)o.size())
+                : bia_msg_encode(&bia, src, n, &o[0], (long)o.size());
+      }
+      if (r <= (long)o.size())
+        return r;
+      o.resize(r);
+    }
+  }
+
+  /**
+   * Run c.in through the target tries times, keeping the least cost, and
+   * check it codes back; returns false if it doesn't
+   */
+  bool run(fuzz_case &c, int tries) {
+    long n = (long)c.in.size();
+
+    c.cost = 0;
+    for (int t = 0; t < tries; ++t) {
+      unsigned long long t0 = fuzz_ticks();
+      outlen = code(decomp, &c.in[0], n, out);
+      double cost = (double)(fuzz_ticks() - t0) / std::max(n, fuzz_min);
+      if (t == 0 || cost < c.cost)
+        c.cost = cost;
+    }
+    c.expand = (double)outlen / n;
+    return code(1 - decomp, &out[0], outlen, back) == n && std::equal(c.in.begin(), c.in.end(), back.begin());
+  }
+
+  // What the last run covered, as one number
+  long feature(const fuzz_case &c) const {
+    return (((long)log2_bucket((double)c.in.size()) * 64 + log2_bucket(c.expand * 16)) * 64 + log2_bucket(c.cost)) * 2 +
+           frxx;
+  }
+
+private:
+  fuzz_target(const fuzz_target &);
+  void operator=(const fuzz_target &);
+};
+
+static void mutate(std::vector<BYTE> &v, const std::vector<BYTE> &other, long maxlen, unsigned *seed) {
+  int rounds = 1 + fuzz_rand(seed) % 4;
+
+  for (int r = 0; r < rounds; ++r) {
+    long n = (long)v.size(), i = n ? fuzz_rand(seed) % n : 0, k = 1 + fuzz_rand(seed) % 32;
+
+    switch (fuzz_rand(seed) % 8) {
+    case 0: // Flip a bit
+      if (n)
+        v[i] ^= (BYTE)(1 << (fuzz_rand(seed) % 8));
+      break;
+    case 1: // Change a byte
+      if (n)
+        v[i] = (BYTE)fuzz_rand(seed);
+      break;
+    case 2: // Insert random bytes
+      for (long j = 0; j < k; ++j)
+        v.insert(v.begin() + i, (BYTE)fuzz_rand(seed));
+      break;
+    case 3: // Delete bytes
+      v.erase(v.begin() + i, v.begin() + std::min(n, i + k));
+      break;
+    case 4: // Run of 00 or ff
+      v.insert(v.begin() + i, k * 4, (BYTE)(fuzz_rand(seed) & 1 ? 0xff : 0));
+      break;
+    case 5: // Repeat a piece of the input
+      if (n) {
+        long j = fuzz_rand(seed) % n, m = std::min(k * 4, n - j);
+        std::vector<BYTE> piece(v.begin() + j, v.begin() + j + m);
+        v.insert(v.begin() + i, piece.begin(), piece.end());
+      }
+      break;
+    case 6: // Splice in the tail of another input
+      if (!other.empty()) {
+        long j = fuzz_rand(seed) % other.size();
+        v.resize(i);
+        v.insert(v.end(), other.begin() + j, other.end());
+      }
+      break;
+    default: // Add or clear one bit of every byte in a stretch
+      for (long j = i, b = 1 << (fuzz_rand(seed) % 8); j < std::min(n, i + k * 8); ++j)
+        v[j] = (BYTE)(fuzz_rand(seed) & 1 ? v[j] | b : v[j] & ~b);
+      break;
+    }
+  }
+  if ((long)v.size() > maxlen)
+    v.resize(maxlen);
+  if (v.empty())
+    v.push_back((BYTE)fuzz_rand(seed));
+}
+
+// Keep the fuzz_keep worst by key, worst first
+static void keep_worst(std::vector<fuzz_case> &worst, const fuzz_case &c, double fuzz_case::*key) {
+  if ((long)worst.size() == fuzz_keep && c.*key <= worst.back().*key)
+    return;
+  worst.push_back(c);
+  std::sort(worst.begin(), worst.end(), [&](const fuzz_case &x, const fuzz_case &y) { return x.*key > y.*key; });
+  if ((long)worst.size() > fuzz_keep)
+    worst.pop_back();
+}
+
+static std::string corpus_prefix(int eng, int decomp) {
+  return std::string(fuzz_name[eng]) + (decomp ? ".d." : ".c.");
+}
+
+static void load_corpus(const char *dir, int eng, int decomp, std::vector<fuzz_case> &seeds) {
+  std::string prefix = corpus_prefix(eng, decomp);
+  DIR *d = opendir(dir);
+  struct dirent *de;
+
+  if (d == NULL)
+    return;
+  while ((de = readdir(d)) != NULL) {
+    if (strncmp(de->d_name, prefix.c_str(), prefix.size()) != 0)
+      continue;
+    std::string path = std::string(dir) + "/" + de->d_name;
+    FILE *f = fopen(path.c_str(), "rb");
+    fuzz_case c;
+    int ch;
+
+    if (f == NULL)
+      continue;
+    while ((ch = getc(f)) != EOF)
+      c.in.push_back((BYTE)ch);
+    fclose(f);
+    if (!c.in.empty())
+      seeds.push_back(c);
+  }
+  closedir(d);
+}
+
+static bool save_corpus(const char *dir, int eng, int decomp, const std::vector<fuzz_case> &keep) {
+  for (size_t i = 0; i < keep.size(); ++i) {
+    std::string path = std::string(dir) + "/" + corpus_prefix(eng, decomp) + std::to_string(i);
+    FILE *f = fopen(path.c_str(), "wb");
+
+    if (f == NULL || fwrite(&keep[i].in[0], 1, keep[i].in.size(), f) != keep[i].in.size() || fclose(f) != 0) {
+      fprintf(stderr, "Could not write corpus file: %s\n", path.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  long maxlen = 1024, iters = 20000;
+  unsigned seed = 1;
+  const char *dir = NULL;
+  bool replay = false;
+  int a, e0 = 0, e1 = FUZZ_COUNT, fail = 0;
+
+  for (a = 1; a < argc && argv[a][0] == '-'; ++a) {
+    if (strcmp(argv[a], "-r") == 0) {
+      replay = true;
+    } else if (a + 1 >= argc) {
+      break;
+    } else if (strcmp(argv[a], "-e") == 0) {
+      for (e0 = FUZZ_COUNT - 1; e0 >= 0 && strcmp(argv[a + 1], fuzz_name[e0]); --e0)
+        ;
+      if (e0 < 0) {
+        fprintf(stderr, "Unknown engine: %s\n", argv[a + 1]);
+        return 1;
+      }
+      e1 = e0 + 1;
+      ++a;
+    } else if (strcmp(argv[a], "-n") == 0) {
+      maxlen = atol(argv[++a]);
+    } else if (strcmp(argv[a], "-i") == 0) {
+      iters = atol(argv[++a]);
+    } else if (strcmp(argv[a], "-s") == 0) {
+      seed = (unsigned)atol(argv[++a]);
+    } else if (strcmp(argv[a], "-c") == 0) {
+      dir = argv[++a];
+    } else {
+      break;
+    }
+  }
+  if (a != argc || maxlen < 1 || iters < 0 || (replay && !dir)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  printf("%-8s %3s %8s %12s %8s %12s %8s %8s\n", "engine", "dir", "inputs", "worst cyc/B", "bytes", "random cyc/B",
+         "expand", "corpus");
+
+  for (int e = e0; e < e1; ++e) {
+    for (int decomp = 0; decomp < 2; ++decomp) {
+      fuzz_target t(e, decomp);
+      std::vector<fuzz_case> corpus, slow, wide;
+      std::set<long> seen;
+      double typical = 0;
+      long tried = 0;
+
+      if (dir)
+        load_corpus(dir, e, decomp, corpus);
+
+      // Random inputs of the largest size: the cost to compare with
+      for (int i = 0; i < 5; ++i) {
+        fuzz_case c;
+        c.in.resize(maxlen);
+        for (long j = 0; j < maxlen; ++j)
+          c.in[j] = (BYTE)fuzz_rand(&seed);
+        if (!replay)
+          corpus.push_back(c);
+        t.run(c, 3);
+        typical += c.cost / 5;
+      }
+      if (!replay) {
+        fuzz_case c;
+        c.in.assign(std::min(maxlen, 64L), 0);
+        corpus.push_back(c);
+        c.in.assign(std::min(maxlen, 64L), 0xff);
+        corpus.push_back(c);
+      }
+
+      // The corpus first, then mutations of the worst and covering inputs
+      long nseeds = (long)corpus.size();
+      for (long i = 0; i < nseeds + (replay ? 0 : iters); ++i) {
+        fuzz_case c;
+
+        if (i < nseeds) {
+          c.in = corpus[i].in;
+        } else {
+          const std::vector<fuzz_case> &from = (fuzz_rand(&seed) & 1) && !slow.empty() ? slow : corpus;
+          c.in = from[fuzz_rand(&seed) % from.size()].in;
+          mutate(c.in, corpus[fuzz_rand(&seed) % corpus.size()].in, maxlen, &seed);
+        }
+        ++tried;
+        if (!t.run(c, 1)) {
+          fprintf(stderr, "%s: %s of a %ld byte input does not code back\n", fuzz_name[e], decomp ? "decoding" : "encoding",
+                  (long)c.in.size());
+          fail = 1;
+          break;
+        }
+        if (slow.size() < (size_t)fuzz_keep || c.cost > slow.back().cost)
+          t.run(c, 3);
+        keep_worst(slow, c, &fuzz_case::cost);
+        keep_worst(wide, c, &fuzz_case::expand);
+        if (seen.insert(t.feature(c)).second && i >= nseeds)
+          corpus.push_back(c);
+      }
+
+      if (!slow.empty())
+        printf("%-8s %3s %8ld %12.0f %8lu %12.0f %8.3f %8lu\n", fuzz_name[e], decomp ? "d" : "c", tried, slow[0].cost,
+               (unsigned long)slow[0].in.size(), typical, wide[0].expand, (unsigned long)corpus.size());
+      fflush(stdout);
+      if (dir && !replay && !fail) {
+        slow.insert(slow.end(), wide.begin(), wide.end());
+        if (!save_corpus(dir, e, decomp, slow))
+          fail = 1;
+      }
+      if (fail)
+        return fail;
+    }
+  }
+  return fail;
+}
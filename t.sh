@@ -1,6 +1,18 @@
 #!/bin/bash
 set -e
 
+# Work in a scratch directory that goes away with the script, using the
+# tools built in the repo and copies of the inputs
+R=$(pwd)
+T=$(mktemp -d)
+trap 'rm -rf "$T"' EXIT
+cd "$T"
+for f in arb255 biacode msgbench mkprime arbar arbd arbc ringbench bwtsbench bijcheck slowfuzz iocheck \
+         arb255_prof unarb255_prof biacode_prof; do
+    ln -s "$R/$f" .
+done
+cp "$R/arb255.cpp" "$R/biacode.cpp" "$R/bit_byts.inc" "$R/arb255.md" "$R/biacode.md" .
+
 echo "Running tests..."
 
 echo "Test 1: arb255 compress arb255.cpp -> 1"
@@ -27,6 +39,245 @@ echo "Test 7: biacode decompress arb255.cpp -> 7"
 echo "Test 8: biacode compress 7 -> 8"
 ./biacode c 7 8
 
+echo "Test 9: message API round trip (64 B - 4 KB, both engines)"
+./msgbench 20 > /dev/null
+
+echo "Test 10: primed models (mkprime, -p) and shared base streams -> 10, 11"
+./msgbench -w sample.rec
+./mkprime arb255 model.arb sample.rec
+./mkprime biacode model.bia sample.rec
+./arb255 c -p model.arb arb255.cpp p1
+./arb255 d -p model.arb p1 10
+./biacode c -p model.bia arb255.cpp p2
+./biacode d -p model.bia p2 11
+./msgbench -p model.arb -p model.bia -s 200 20 > /dev/null
+
+echo "Test 11: seekable containers (-s, -i) -> 12, 13"
+./arb255 c -s -f 1000 arb255.cpp s1
+./arb255 d -s s1 12
+./biacode c -s -f 777 -i s2.idx arb255.cpp s2
+./biacode d -s -i s2.idx s2 13
+./arb255 d --range 1500:2100 s1 r1
+./biacode d --range 1500:2100 -i s2.idx s2 r2
+tail -c +1501 arb255.cpp | head -c 2100 > r0
+cmp r0 r1
+cmp r0 r2
+
+echo "Test 12: multi-file archive (both engines, both I/O backends) -> 14, 15"
+rm -rf arc.x
+mkdir -p arc.x/a arc.x/b arc.x/c
+./arbar c -j 3 a1 arb255.cpp biacode.cpp bit_byts.inc sample.rec
+./arbar c -e biacode -p model.bia -j 3 a2 arb255.cpp arb255.md biacode.md
+./arbar t a1 > /dev/null
+./arbar c -I sync -j 2 a3 arb255.cpp biacode.cpp bit_byts.inc sample.rec
+cmp a1 a3
+./arbar x -j 3 -C arc.x/a a1
+./arbar x -I sync -C arc.x/c a3
+for f in arb255.cpp biacode.cpp bit_byts.inc sample.rec; do cmp $f arc.x/c/$f; done
+./arbar x -p model.bia -j 3 -C arc.x/b a2
+for f in arb255.cpp biacode.cpp bit_byts.inc sample.rec; do cmp $f arc.x/a/$f; done
+for f in arb255.cpp arb255.md biacode.md; do cmp $f arc.x/b/$f; done
+cp arc.x/a/arb255.cpp 14
+cp arc.x/b/arb255.cpp 15
+# Corrupt directories: a size no file can have, and a file that decodes
+# past its size
+printf 'A' > k1
+printf 'ADIR\000\001\002x1\200\200\200\200\200\200\200\002\001\000' >> k1
+printf '\023\000\000\000\000\000\000\000ARBARC01' >> k1
+RC=0
+./arbar x -C arc.x k1 2> k2 || RC=$?
+test $RC -eq 2
+grep -q "Corrupt archive directory" k2
+head -c 1000000 /dev/zero > k2
+./arb255 c k2 k1
+printf 'ADIR\000\001\002x1\012'"\\$(printf %o $(stat -c %s k1))"'\000' >> k1
+printf '\014\000\000\000\000\000\000\000ARBARC01' >> k1
+RC=0
+./arbar x -C arc.x k1 2> k2 || RC=$?
+test $RC -eq 1
+grep -q "Does not decode to its size" k2
+
+echo "Test 13: compression daemon (arbd, arbc) -> 16, 17"
+rm -f arbd.sock
+./arbd -j 2 -p model.bia arbd.sock 2> /dev/null &
+ARBD=$!
+trap 'kill $ARBD 2> /dev/null || true; rm -rf "$T"' EXIT
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S arbd.sock ] && break; sleep 0.1; done
+./arbc arbd.sock c arb255.cpp d1
+cmp d1 1
+./arbc arbd.sock d d1 16
+./arbc arbd.sock c -e biacode arb255.cpp d2
+cmp d2 p2
+./arbc arbd.sock d -e biacode - - < d2 > 17
+./arbc arbd.sock stats > /dev/null
+./arbc arbd.sock stop
+wait $ARBD
+trap 'rm -rf "$T"' EXIT
+
+echo "Test 14: shared memory ring transport (both engines)"
+./ringbench -P 3 -r 8 200 > /dev/null
+./ringbench -e biacode -P 3 -m 1000 -r 8 100 > /dev/null
+
+echo "Test 15: read-ahead/write-behind pipeline (-a) -> 18, 19"
+./arb255 c -a arb255.cpp q1
+cmp q1 1
+./arb255 d -a q1 18
+./biacode c -a arb255.cpp q2
+cmp q2 3
+./biacode d -a q2 19
+
+echo "Test 16: zero-copy output into a pipe (-z) -> 20, 21"
+./arb255 c -z arb255.cpp /dev/stdout 2>/dev/null | cat > z1
+cmp z1 1
+./arb255 d -z z1 /dev/stdout 2>/dev/null | cat > 20
+./biacode c -z arb255.cpp /dev/stdout | cat > z2
+cmp z2 3
+./biacode d -z z2 /dev/stdout | cat > 21
+
+echo "Test 17: biacode 4096 byte blocks, O_DIRECT output (-b, -D) -> 22"
+./biacode c -b 4096 -D arb255.cpp k1
+if [ $(( $(stat -c %s k1) % 4096 )) -ne 0 ]; then
+    echo "Block output is not a multiple of 4096 bytes"
+    exit 1
+fi
+./biacode d -b 4096 -D k1 22
+
+echo "Test 18: bijective BWT + MTF front end (-w) -> 23, 24"
+./arb255 c -w 4 -j 2 arb255.cpp w1
+./arb255 d -w 4 -j 2 w1 23
+./biacode c -w 4 -j 2 arb255.cpp w2
+./biacode d -w 4 -j 2 w2 24
+# Any file decodes to something that codes back to it
+./arb255 d -w 4 1 w3
+./arb255 c -w 4 w3 w4
+cmp 1 w4
+./biacode d -w 4 3 w5
+./biacode c -w 4 w5 w6
+cmp 3 w6
+./bwtsbench -w 4 arb255.cpp
+
+echo "Test 19: bijective run-length stage (-r)"
+{ head -c 50000 /dev/zero; cat arb255.cpp; head -c 70000 /dev/zero; } > sp0
+./arb255 c -r sp0 r3
+./arb255 d -r r3 sp1
+cmp sp0 sp1
+./biacode c -r -w 16 sp0 r4
+./biacode d -r -w 16 r4 sp2
+cmp sp0 sp2
+./arb255 d -r 1 r5
+./arb255 c -r r5 r6
+cmp 1 r6
+
+echo "Test 20: byte shuffle and delta stage (-t)"
+./arb255 c -t 4d arb255.cpp t1
+./arb255 d -t 4d t1 25
+./biacode c -t 8x -w 16 arb255.cpp t2
+./biacode d -t 8x -w 16 t2 26
+./arb255 d -t 2 1 t3
+./arb255 c -t 2 t3 t4
+cmp 1 t4
+
+echo "Test 21: nibble coder (-n) -> 27, 28"
+./arb255 c -n arb255.cpp n1
+./arb255 d -n n1 27
+./arb255 c -n -a -t 2 arb255.cpp n2
+./arb255 d -n -a -t 2 n2 28
+./arb255 d -n 1 n3
+./arb255 c -n n3 n4
+cmp 1 n4
+: > n3
+./arb255 c -n n3 n4
+test ! -s n4
+./arb255 d -n n3 n4
+test ! -s n4
+
+echo "Test 22: size estimates from the models alone (e, -S)"
+check_estimate() {
+    EST=$(awk '/estimate:/ {print $5}' "$1")
+    if [ $(( (EST - $2) * 100 / $2 )) -ne 0 ]; then
+        echo "Estimate $EST is more than 1% off $2"
+        exit 1
+    fi
+}
+./arb255 e arb255.cpp > e1
+check_estimate e1 $(stat -c %s 1)
+./biacode e arb255.cpp > e2
+check_estimate e2 $(stat -c %s 3)
+./arb255 e -t 4d -S 50 arb255.cpp > /dev/null
+./biacode e -p model.bia -w 4 -S 10 /dev/stdin < arb255.cpp > /dev/null
+
+echo "Test 23: best of engines and transforms per file (-e best) -> 29"
+rm -rf arc.x
+mkdir -p arc.x
+head -c 100000 /dev/urandom > b1
+./arbar c -e best -p model.bia -j 3 b2 arb255.cpp sample.rec b1
+./arbar t b2 > b3
+grep -q " 100000  stored .* b1$" b3
+./arbar x -p model.bia -j 3 -C arc.x b2
+for f in arb255.cpp sample.rec b1; do cmp $f arc.x/$f; done
+cp arc.x/arb255.cpp 29
+
+echo "Test 24: sparse input, long runs of the decoder fast path"
+{ head -c 100000 /dev/zero; head -c 3000 arb255.cpp; head -c 100000 /dev/zero; } > sp3
+./arb255 c sp3 sp4
+./arb255 d sp4 sp5
+cmp sp3 sp5
+
+echo "Test 25: exhaustive bijectivity, every string up to 2 bytes (bijcheck)"
+./bijcheck 2 | grep -q "^All strings code both ways"
+
+echo "Test 26: slow input fuzzing and corpus replay (slowfuzz)"
+rm -rf fz
+mkdir fz
+./slowfuzz -n 64 -i 300 -c fz
+./slowfuzz -r -c fz
+
+echo "Test 27: decode budgets for untrusted input (--max-*) -> 30"
+./arb255 d --max-out $(stat -c %s arb255.cpp) 1 30
+head -c 1000000 /dev/zero > u1
+./arb255 c u1 u2
+RC=0
+./arb255 d --max-ratio 100 u2 u3 || RC=$?
+test $RC -eq 3
+test $(stat -c %s u3) -eq $((100 * $(stat -c %s u2)))
+cmp -n $(stat -c %s u3) u1 u3
+RC=0
+./biacode d --max-out 1000 3 u4 || RC=$?
+test $RC -eq 3
+test $(stat -c %s u4) -eq 1000
+cmp -n 1000 arb255.cpp u4
+./arb255 c -n u1 u5
+RC=0
+./arb255 d -n --max-ratio 100 u5 u6 || RC=$?
+test $RC -eq 3
+test $(stat -c %s u6) -eq $((100 * $(stat -c %s u5)))
+cmp -n $(stat -c %s u6) u1 u6
+RC=0
+./arb255 d -w 4 --max-out 5000 u2 u6 2> /dev/null || RC=$?
+test $RC -eq 1
+RC=0
+./biacode d -t 4d --max-out 5001 3 u6 2> /dev/null || RC=$?
+test $RC -eq 10
+
+echo "Test 28: phase profiled builds (-DARB_PROFILE) -> 31"
+./arb255_prof c arb255.cpp v1 2> v4
+grep -q "^Phase profile" v4
+cmp v1 1
+./arb255_prof d v1 31 2> v4
+grep -q "^free end" v4
+./unarb255_prof v1 v2 2> v4
+grep -q "^renorm" v4
+cmp v2 arb255.cpp
+ARB_PROFILE_EVERY=1 ./biacode_prof c arb255.cpp v3 2> v4
+grep -q "^Phase profile: 1 in 1 of" v4
+cmp v3 3
+
+echo "Test 29: batched reads and writes of a file over 2 GiB (iocheck)"
+truncate -s 2200000000 g1
+printf 'tail' >> g1
+./iocheck g1
+rm -f g1
+
 echo ""
 echo "Checking file hashes..."
 
@@ -36,7 +287,7 @@ echo "Original arb255.cpp hash: $ORIGINAL_HASH"
 
 # Check each output file
 FAIL=0
-for file in 2 4 6 8; do
+for file in 2 4 6 8 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31; do
     if [ ! -f "$file" ]; then
         echo "ERROR: File '$file' does not exist!"
         FAIL=1
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "bit_byts.inc"
+#include "prof.inc"
 
 /**
  * Two-state frequency model (must match encoder)
@@ -209,7 +210,9 @@ void inc_fre(void)
 inline int input_bit(void)
 {
     int t;
+    PROF_PHASE(PROF_IO);
     t = dasr;
+    PROF_PHASE(PROF_RENORM);
 
     if (t < 0) {
         if (t == -1)
@@ -263,13 +266,16 @@ int main(int argc, char *argv[])
             putc('.', stderr);
 
         // Decode next bit using current context model
+        PROF_SYMBOL(PROF_MODEL);
         ch = decode_symbol(ff[cc]);
+        PROF_PHASE(PROF_IO);
         dasw(ch);
 
         if (ch == -1)
             break;  // End of stream detected
 
         // Update frequency model (must match encoder)
+        PROF_PHASE(PROF_MODEL);
         if (ch == 1)
             ff[cc].Fone++;
         ff[cc].Ftot++;
@@ -361,6 +367,7 @@ int decode_symbol(bij_2c ff)
     static int EXX = 0;           // Error counter
     int symbol = 0;               // Decoded symbol
 
+    PROF_PHASE(PROF_SPLIT);
     oldlow = low;
     oldhigh = high;
 
@@ -432,6 +439,7 @@ int decode_symbol(bij_2c ff)
      * The decoder must track free ends identically to encoder
      * to detect the end-of-stream marker correctly.
      */
+    PROF_PHASE(PROF_FREE);
     if (FRX != 0) {
         fprintf(stderr, "\n HERE AT LAST ");
         if (low > freeend)
@@ -474,6 +482,7 @@ int decode_symbol(bij_2c ff)
      * As the interval narrows, remove leading bits that are now determined.
      * Must mirror encoder's bit output logic exactly.
      */
+    PROF_PHASE(PROF_RENORM);
     for (;;) {
         if (high < Half) {
             // Entire interval in lower half